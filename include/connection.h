@@ -0,0 +1,86 @@
+/*------------------------------------------------------------------
+*
+*				Foreign data wrapper for TDS (Sybase and Microsoft SQL Server)
+*
+* Author: Geoff Montee
+* Name: tds_fdw
+* File: tds_fdw/include/connection.h
+*
+* Description:
+* This is a PostgreSQL foreign data wrapper for use to connect to databases that use TDS,
+* such as Sybase databases and Microsoft SQL server.
+*
+* This foreign data wrapper requires requires a library that uses the DB-Library interface,
+* such as FreeTDS (http://www.freetds.org/). This has been tested with FreeTDS, but not
+* the proprietary implementations of DB-Library.
+*----------------------------------------------------------------------------
+*/
+
+
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include "postgres.h"
+
+/* DB-Library headers (e.g. FreeTDS) */
+#include <sybfront.h>
+#include <sybdb.h>
+
+#include "options.h"
+
+typedef int (*TdsFdwMsgHandler) (DBPROCESS *dbproc, DBINT msgno, int msgstate, int severity, char *msgtext, char *svr_name, char *proc_name, int line);
+
+/* per-connection state, attached to each DBPROCESS with dbsetuserdata() */
+typedef struct TdsFdwConnState
+{
+    TdsFdwMsgHandler msg_handler;   /* handler for messages from the server */
+    bool invalidated;               /* server or user mapping changed */
+    bool vendor_checked;            /* is is_sqlserver set yet? */
+    bool is_sqlserver;              /* Microsoft SQL Server, or Sybase */
+} TdsFdwConnState;
+
+/*
+ * Initialize DB-Library for this backend, if that wasn't done yet. The
+ * library is shut down again when the backend exits.
+ */
+void tdsInitDbLibrary(void);
+
+/*
+ * Get a connection to the given foreign server for the current user.
+ *
+ * Connections are cached per backend and keyed by foreign server and user
+ * mapping, so a connection can be reused by later scans, remote estimates
+ * and IMPORT FOREIGN SCHEMA. If all cached connections are busy, another one
+ * is opened and added to the cache. The connection must be handed back with
+ * tdsReleaseConnection() once the caller is done with it.
+ *
+ * The login time, and from time to time the round trip time, are recorded
+ * in the server statistics for the planner.
+ */
+DBPROCESS *tdsGetConnection(Oid serverid, TdsFdwOptionSet *option_set);
+
+/*
+ * Hand a connection obtained from tdsGetConnection() back to the cache.
+ * Any results that were not read yet are discarded.
+ */
+void tdsReleaseConnection(DBPROCESS *dbproc);
+
+/*
+ * Close a connection obtained from tdsGetConnection() instead of handing it
+ * back, e.g. because a query on it was given up on half way.
+ */
+void tdsDiscardConnection(DBPROCESS *dbproc);
+
+/*
+ * Does this backend have an idle connection to the given foreign server, for
+ * any user mapping?
+ */
+bool tdsHaveCachedConnection(Oid serverid);
+
+/*
+ * Get the state of a connection. While a connection is being set up, this
+ * returns the state of the connection in progress.
+ */
+TdsFdwConnState *tdsGetConnState(DBPROCESS *dbproc);
+
+#endif
@@ -154,5 +154,12 @@ appendWhereClause(StringInfo buf,
 void
 appendOrderByClause(StringInfo buf, PlannerInfo *root, RelOptInfo *baserel,
 					List *pathkeys);
+
+/*
+ * Quote an identifier with square brackets, the way SQL Server and Sybase
+ * expect it.
+ */
+const char *
+tds_quote_identifier(const char *ident);
 					
 #endif
\ No newline at end of file
@@ -0,0 +1,58 @@
+/*------------------------------------------------------------------
+*
+*				Foreign data wrapper for TDS (Sybase and Microsoft SQL Server)
+*
+* Author: Geoff Montee
+* Name: tds_fdw
+* File: tds_fdw/include/estimate_cache.h
+*
+* Description:
+* This is a PostgreSQL foreign data wrapper for use to connect to databases that use TDS,
+* such as Sybase databases and Microsoft SQL server.
+*
+* This foreign data wrapper requires requires a library that uses the DB-Library interface,
+* such as FreeTDS (http://www.freetds.org/). This has been tested with FreeTDS, but not
+* the proprietary implementations of DB-Library.
+*----------------------------------------------------------------------------
+*/
+
+
+#ifndef ESTIMATE_CACHE_H
+#define ESTIMATE_CACHE_H
+
+#include "postgres.h"
+#include "fmgr.h"
+
+/*
+ * The estimate cache lives in shared memory when tds_fdw is loaded through
+ * shared_preload_libraries, and is local to the backend otherwise.
+ */
+#if (PG_VERSION_NUM >= 90600)
+#define TDS_SHARED_ESTIMATE_CACHE
+#endif
+
+/*
+ * the longest remote query, in bytes after normalization, whose estimate is
+ * cached. Each entry of the shared cache has room for a query this long.
+ */
+#define TDS_ESTIMATE_CACHE_QUERY_LEN 2048
+
+/* define GUCs and, at preload time, request shared memory */
+void tdsEstimateCacheInit(void);
+
+/*
+ * Look up the row estimate of a remote query on a foreign server. Returns
+ * false if there is no entry or, unless allow_stale is set, it is older than
+ * tds_fdw.estimate_cache_ttl.
+ */
+bool tdsEstimateCacheLookup(Oid serverid, const char *query, bool allow_stale, double *rows);
+
+/* remember the row estimate of a remote query on a foreign server */
+void tdsEstimateCacheStore(Oid serverid, const char *query, double rows);
+
+/* functions called via SQL */
+
+extern Datum tds_fdw_estimate_cache(PG_FUNCTION_ARGS);
+extern Datum tds_fdw_estimate_cache_reset(PG_FUNCTION_ARGS);
+
+#endif
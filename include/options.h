@@ -26,6 +26,10 @@ typedef struct TdsFdwOptionSource
     TdsFdwOptionSourceType source;
 } TdsFdwOptionSource;
 
+/* fdw_startup_cost or fdw_tuple_cost set to "auto" */
+
+#define TDS_AUTO_COST -1
+
 /* option values will be put here */
 
 typedef struct TdsFdwOptionSet
@@ -43,13 +47,21 @@ typedef struct TdsFdwOptionSet
     char *query;
     char *schema_name;
     char *table_name;
+    char *partition_column;
     char* row_estimate_method;
+    char* analyze_method;
     bool sqlserver_ansi_mode;
     bool match_column_names;
+    bool truncate_lobs;
+    bool async_capable;
+    bool early_dispatch;
     bool use_remote_estimate;
     int fdw_startup_cost;
     int fdw_tuple_cost;
     int local_tuple_estimate;
+    int estimate_timeout;
+    int fetch_size;
+    int max_lob_size;
 } TdsFdwOptionSet;
 
 void tdsValidateOptions(List *options_list, Oid context, TdsFdwOptionSet* option_set);
@@ -0,0 +1,49 @@
+/*------------------------------------------------------------------
+*
+*				Foreign data wrapper for TDS (Sybase and Microsoft SQL Server)
+*
+* Author: Geoff Montee
+* Name: tds_fdw
+* File: tds_fdw/include/remote_stats.h
+*
+* Description:
+* This is a PostgreSQL foreign data wrapper for use to connect to databases that use TDS,
+* such as Sybase databases and Microsoft SQL server.
+*
+* This foreign data wrapper requires requires a library that uses the DB-Library interface,
+* such as FreeTDS (http://www.freetds.org/). This has been tested with FreeTDS, but not
+* the proprietary implementations of DB-Library.
+*----------------------------------------------------------------------------
+*/
+
+
+#ifndef REMOTE_STATS_H
+#define REMOTE_STATS_H
+
+#include "postgres.h"
+#include "utils/relcache.h"
+
+/* DB-Library headers (e.g. FreeTDS) */
+#include <sybfront.h>
+#include <sybdb.h>
+
+/*
+ * Statistics are written to pg_statistic directly, which is only done for
+ * the catalog layout of PostgreSQL 12 and later.
+ */
+#if (PG_VERSION_NUM >= 120000)
+#define TDS_IMPORT_REMOTE_STATISTICS
+#endif
+
+#ifdef TDS_IMPORT_REMOTE_STATISTICS
+/*
+ * Convert the histograms that MS SQL Server keeps for the columns of
+ * remote_relation into pg_statistic entries for the foreign table relation.
+ * Columns are matched by name if match_column_names is set, otherwise by
+ * position. Returns the number of columns that got statistics.
+ */
+int tdsImportRemoteStatistics(Relation relation, DBPROCESS *dbproc,
+	const char *remote_relation, bool match_column_names);
+#endif
+
+#endif
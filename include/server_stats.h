@@ -0,0 +1,79 @@
+/*------------------------------------------------------------------
+*
+*				Foreign data wrapper for TDS (Sybase and Microsoft SQL Server)
+*
+* Author: Geoff Montee
+* Name: tds_fdw
+* File: tds_fdw/include/server_stats.h
+*
+* Description:
+* This is a PostgreSQL foreign data wrapper for use to connect to databases that use TDS,
+* such as Sybase databases and Microsoft SQL server.
+*
+* This foreign data wrapper requires requires a library that uses the DB-Library interface,
+* such as FreeTDS (http://www.freetds.org/). This has been tested with FreeTDS, but not
+* the proprietary implementations of DB-Library.
+*----------------------------------------------------------------------------
+*/
+
+
+#ifndef SERVER_STATS_H
+#define SERVER_STATS_H
+
+#include "postgres.h"
+#include "fmgr.h"
+
+/*
+ * Like the estimate cache, the server statistics live in shared memory when
+ * tds_fdw is loaded through shared_preload_libraries, and are local to the
+ * backend otherwise.
+ */
+#if (PG_VERSION_NUM >= 90600)
+#define TDS_SHARED_SERVER_STATS
+#endif
+
+/* how many foreign servers are tracked */
+#define TDS_SERVER_STATS_MAX_ENTRIES 256
+
+/* define GUCs and, at preload time, request shared memory */
+void tdsServerStatsInit(void);
+
+/* add a measured login time, in milliseconds */
+void tdsServerStatsAddConnect(Oid serverid, double connect_ms);
+
+/* add a measured round trip time, in milliseconds */
+void tdsServerStatsAddRoundTrip(Oid serverid, double rtt_ms);
+
+/*
+ * Is a new round trip measurement due, because there is none yet or the
+ * last one is older than tds_fdw.latency_sample_interval?
+ */
+bool tdsServerStatsRoundTripDue(Oid serverid);
+
+/*
+ * Get the averaged login and round trip times of a foreign server, in
+ * milliseconds. Returns false if no round trip was measured yet. connect_ms
+ * is set to -1 if no login was measured yet.
+ */
+bool tdsServerStatsGetLatency(Oid serverid, double *connect_ms, double *rtt_ms);
+
+/*
+ * add a finished scan: the time until the remote server returned its first
+ * result, the time spent fetching rows, and how many rows and bytes were
+ * fetched
+ */
+void tdsServerStatsAddScan(Oid serverid, double startup_ms, double fetch_ms,
+    double rows, double bytes);
+
+/*
+ * Get the averaged startup time of scans of a foreign server, and the time
+ * it took to fetch a byte, in milliseconds. Returns false if no scan has
+ * finished yet. ms_per_byte is set to -1 if no rows were fetched yet.
+ */
+bool tdsServerStatsGetScanTimes(Oid serverid, double *startup_ms, double *ms_per_byte);
+
+/* functions called via SQL */
+
+extern Datum tds_fdw_server_stats(PG_FUNCTION_ARGS);
+
+#endif
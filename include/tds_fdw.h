@@ -38,6 +38,12 @@
 #include "optimizer/planmain.h"
 #endif
 
+#if (PG_VERSION_NUM >= 90500)
+#include "utils/sampling.h"
+#endif
+
+#include "portability/instr_time.h"
+
 /* DB-Library headers (e.g. FreeTDS) */
 #include <sybfront.h>
 #include <sybdb.h>
@@ -50,10 +56,39 @@
 #undef IMPORT_API
 #endif  /* PG_VERSION_NUM */
 
+#if PG_VERSION_NUM >= 140000
+#define ASYNC_API
+#else
+#undef ASYNC_API
+#endif  /* PG_VERSION_NUM */
+
+#if PG_VERSION_NUM >= 90600
+#define PARALLEL_API
+#else
+#undef PARALLEL_API
+#endif  /* PG_VERSION_NUM */
+
+#ifdef PARALLEL_API
+#include "access/parallel.h"
+#include "storage/spin.h"
+#endif  /* PARALLEL_API */
+
+/*
+ * Messages about single rows and values, which would slow down every scan
+ * even when they are not logged, are only compiled into builds with DEBUG.
+ * Otherwise each scan logs a summary when it ends.
+ */
+#ifdef DEBUG
+#define TDS_TRACE(...) ereport(DEBUG3, (errmsg("tds_fdw: " __VA_ARGS__)))
+#else
+#define TDS_TRACE(...) ((void) 0)
+#endif
+
 /* a column */
 
 typedef union COL_VALUE
 {
+	DBBIT dbbit;
 	DBSMALLINT dbsmallint;
 	DBINT dbint;
 	DBBIGINT dbbigint;
@@ -61,16 +96,32 @@ typedef union COL_VALUE
 	DBFLT8 dbflt8;
 } COL_VALUE;
 
+struct COL;
+struct TdsFdwExecutionState;
+
+/* makes a datum from the data of a fetched column, which is not NULL */
+typedef Datum (*TdsFdwColumnDecoder) (struct TdsFdwExecutionState *festate, struct COL *column, BYTE *src, DBINT srclen);
+
 typedef struct COL
 {
 	char *name;
 	int srctype;
-	bool useraw;
+	int colnum;			/* DB-Library column number, starting at 1 */
 	COL_VALUE value;
 	int local_index;
 	Oid attr_oid;
+	int32 typmod;
+	TdsFdwColumnDecoder decode;
+	TdsFdwColumnDecoder lob_decode;	/* called by decode after the max_lob_size check */
 } COL;
 
+/* a row estimate from the remote server, remembered for the rest of planning */
+typedef struct TdsFdwRemoteEstimate
+{
+	char *query;
+	double rows;
+} TdsFdwRemoteEstimate;
+
 /* This struct is similar to PgFdwRelationInfo from postgres_fdw */
 typedef struct TdsFdwRelationInfo
 {
@@ -85,6 +136,9 @@ typedef struct TdsFdwRelationInfo
 	QualCost	local_conds_cost;
 	Selectivity local_conds_sel;
 
+	/* Selectivity of remote_conds, estimated locally. */
+	Selectivity remote_conds_sel;
+
 	/* Estimated size and cost for a scan with baserestrictinfo quals. */
 	double		rows;
 	int			width;
@@ -93,8 +147,14 @@ typedef struct TdsFdwRelationInfo
 
 	/* Options extracted from catalogs. */
 	bool		use_remote_estimate;
+	bool		async_capable;
 	Cost		fdw_startup_cost;
 	Cost		fdw_tuple_cost;
+
+	/* Network costs, from the measured latency of the server. */
+	Cost		network_startup_cost;
+	Cost		network_tuple_cost;
+
 	/* tds_fdw won't ship any PostgreSQL extensions. remove this later. */
 	//List	   *shippable_extensions;	/* OIDs of whitelisted extensions */
 
@@ -102,26 +162,108 @@ typedef struct TdsFdwRelationInfo
 	ForeignTable *table;
 	ForeignServer *server;
 	UserMapping *user;			/* only set in use_remote_estimate mode */
+
+	/* Remote estimates already made, as TdsFdwRemoteEstimate. */
+	List	   *remote_estimates;
 } TdsFdwRelationInfo;
 
 /* this maintains state */
 
 typedef struct TdsFdwExecutionState
 {
-	LOGINREC *login;
 	DBPROCESS *dbproc;
 	AttInMetadata *attinmeta;
 	char *query;
 	List *retrieved_attrs;
 	int first;
+	bool query_sent;			/* sent, but maybe not executed yet */
 	COL *columns;
-	Datum *datums;
-	bool *isnull;
 	int ncols;
+	COL **decode_columns;		/* the columns that go into the slot */
+	int ndecode_columns;
 	int row;
 	MemoryContext mem_cxt;
+	MemoryContext row_cxt;		/* reset for each row */
+
+	/* rows in DB-Library's row buffer, with fetch_size > 1 */
+	int fetch_size;
+	int batch_rows;				/* rows read into the buffer */
+	int batch_next;				/* next of them to return */
+	DBINT batch_first;			/* row number of the first of them */
+	int batch_status;			/* what dbnextrow() returned after them */
+
+	/* limit for text and image values, 0 for none */
+	int max_lob_size;
+	bool truncate_lobs;
+
+	/* time spent waiting on the remote server, for the server statistics */
+	Oid serverid;
+	int executions;				/* with a timed startup */
+	bool time_startup;			/* false if the query was sent ahead */
+	instr_time query_start;
+	instr_time startup_time;	/* until the first result set */
+	instr_time fetch_time;		/* in dbnextrow() */
+	double bytes;
+
+	/* for the summary at the end of the scan */
+	double null_values;
+	double input_values;		/* converted by input functions */
+
+	/* parallel scans, split by ranges of partition_column */
+	char *range_column;			/* quoted, or NULL if not parallel aware */
+	bool range_has_where;		/* does query have a WHERE clause already? */
+	char *base_query;			/* query without a range */
+	StringInfoData range_query;	/* query for the current range */
+	struct TdsFdwParallelScan *pscan;	/* in shared memory, or NULL */
+	int nranges;				/* copied from pscan, which is gone at the end */
+	int ranges;					/* scanned by this process */
 } TdsFdwExecutionState;
 
+#ifdef PARALLEL_API
+/*
+ * Shared state of a parallel scan. The values of partition_column, from
+ * its minimum to its maximum, are split into nranges ranges of range_step
+ * values each, and each process of the scan takes the next range which no
+ * one scanned yet, until all are taken. The values are integers, so that
+ * each value is in exactly one range.
+ */
+typedef struct TdsFdwParallelScan
+{
+	slock_t		mutex;			/* protects next_range */
+	int			nranges;
+	int			next_range;
+	int64		range_start;
+	uint64		range_step;
+} TdsFdwParallelScan;
+#endif  /* PARALLEL_API */
+
+/* state while sampling rows for ANALYZE */
+
+typedef struct TdsFdwAnalyzeState
+{
+	Relation	rel;
+	AttInMetadata *attinmeta;
+	List	   *retrieved_attrs;	/* local columns, in the order of the remote ones */
+	bool		match_column_names;	/* match remote columns by name, not retrieved_attrs */
+
+	/* collected sample rows */
+	HeapTuple  *rows;
+	int			targrows;
+	int			numrows;
+
+	/* for random sampling */
+	double		samplerows;		/* # of rows fetched */
+	double		rowstoskip;		/* # of rows to skip before next sample */
+#if (PG_VERSION_NUM >= 90500)
+	ReservoirStateData rstate;	/* state for reservoir sampling */
+#else
+	double		rstate;			/* state for reservoir sampling */
+#endif
+
+	MemoryContext anl_cxt;		/* context for per-analyze lifespan data */
+	MemoryContext temp_cxt;		/* context for per-tuple temporary data */
+} TdsFdwAnalyzeState;
+
 /* Callback argument for ec_member_matches_foreign */
 typedef struct
 {
@@ -162,11 +304,32 @@ FdwPlan* tdsPlanForeignScan(Oid foreigntableid, PlannerInfo *root, RelOptInfo *b
 List *tdsImportForeignSchema(ImportForeignSchemaStmt *stmt, Oid serverOid);
 #endif  /* IMPORT_API */
 
+#ifdef PARALLEL_API
+bool tdsIsForeignScanParallelSafe(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte);
+Size tdsEstimateDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt);
+void tdsInitializeDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt, void *coordinate);
+#if (PG_VERSION_NUM >= 100000)
+void tdsReInitializeDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt, void *coordinate);
+#endif
+void tdsInitializeWorkerForeignScan(ForeignScanState *node, shm_toc *toc, void *coordinate);
+#endif  /* PARALLEL_API */
+
+#ifdef ASYNC_API
+bool tdsIsForeignPathAsyncCapable(ForeignPath *path);
+void tdsForeignAsyncRequest(AsyncRequest *areq);
+void tdsForeignAsyncConfigureWait(AsyncRequest *areq);
+void tdsForeignAsyncNotify(AsyncRequest *areq);
+#endif  /* ASYNC_API */
+
 /* compatibility with PostgreSQL 9.6+ */
 #ifndef ALLOCSET_DEFAULT_SIZES
 #define ALLOCSET_DEFAULT_SIZES \
 ALLOCSET_DEFAULT_MINSIZE, ALLOCSET_DEFAULT_INITSIZE, ALLOCSET_DEFAULT_MAXSIZE
 #endif
+#ifndef ALLOCSET_SMALL_SIZES
+#define ALLOCSET_SMALL_SIZES \
+ALLOCSET_SMALL_MINSIZE, ALLOCSET_SMALL_INITSIZE, ALLOCSET_SMALL_MAXSIZE
+#endif
 
 /* compatibility with PostgreSQL v11+ */
 #if PG_VERSION_NUM < 110000
@@ -186,19 +349,33 @@ void tdsBuildForeignQuery(PlannerInfo *root, RelOptInfo *baserel, TdsFdwOptionSe
 	Bitmapset* attrs_used, List** retrieved_attrs, 
 	List* remote_conds, List* remote_join_conds, List* pathkeys);
 int tdsSetupConnection(TdsFdwOptionSet* option_set, LOGINREC *login, DBPROCESS **dbproc);
-double tdsGetRowCount(TdsFdwOptionSet* option_set, LOGINREC *login, DBPROCESS *dbproc);
-double tdsGetRowCountShowPlanAll(TdsFdwOptionSet* option_set, LOGINREC *login, DBPROCESS *dbproc);
-double tdsGetRowCountExecute(TdsFdwOptionSet* option_set, LOGINREC *login, DBPROCESS *dbproc);
-double tdsGetStartupCost(TdsFdwOptionSet* option_set);
+double tdsGetRowCount(TdsFdwOptionSet* option_set, DBPROCESS *dbproc, Selectivity remote_sel);
+double tdsGetRowCountShowPlanAll(TdsFdwOptionSet* option_set, DBPROCESS *dbproc);
+void tdsGetRowCountsShowPlanAll(DBPROCESS *dbproc, int nqueries, char **queries, double *rows);
+double tdsGetRowCountExecute(TdsFdwOptionSet* option_set, DBPROCESS *dbproc);
+double tdsGetRowCountPartitionStats(TdsFdwOptionSet* option_set, DBPROCESS *dbproc);
+double tdsGetStartupCost(Oid serverid, TdsFdwOptionSet* option_set);
+double tdsGetTupleNetworkCost(Oid serverid, int width);
 void tdsGetColumnMetadata(ForeignScanState *node, TdsFdwOptionSet *option_set);
 char* tdsConvertToCString(DBPROCESS* dbproc, int srctype, const BYTE* src, DBINT srclen);
 #if (PG_VERSION_NUM >= 90400)
 int tdsDatetimeToDatum(DBPROCESS *dbproc, DBDATETIME *src, Datum *datetime_out);
 #endif
+#if (PG_VERSION_NUM >= 100000)
+bool tdsCanConvertTemporal(int srctype, Oid attr_oid);
+int tdsTemporalToDatum(int srctype, const BYTE *src, Oid attr_oid, int32 typmod, Datum *datum_out);
+#endif
+#if (PG_VERSION_NUM >= 140000)
+int tdsNumericToDatum(int srctype, const BYTE *src, int32 typmod, Datum *numeric_out);
+#endif
+int tdsMoneyToCashDatum(int srctype, const BYTE *src, Datum *cash_out);
+int tdsUniqueToUuidDatum(const BYTE *src, DBINT srclen, Datum *uuid_out);
+Datum tdsCharToDatum(const char *src, DBINT srclen, Oid attr_oid, int32 typmod);
 
 /* Helper functions for DB-Library API */
 
 int tds_err_handler(DBPROCESS *dbproc, int severity, int dberr, int oserr, char *dberrstr, char *oserrstr);
+int tds_msg_handler(DBPROCESS *dbproc, DBINT msgno, int msgstate, int severity, char *msgtext, char *svr_name, char *proc_name, int line);
 int tds_notice_msg_handler(DBPROCESS *dbproc, DBINT msgno, int msgstate, int severity, char *msgtext, char *svr_name, char *proc_name, int line);
 int tds_blackhole_msg_handler(DBPROCESS *dbproc, DBINT msgno, int msgstate, int severity, char *msgtext, char *svr_name, char *proc_name, int line);
 
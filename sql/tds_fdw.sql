@@ -28,4 +28,41 @@ LANGUAGE C STRICT;
 CREATE FOREIGN DATA WRAPPER tds_fdw
   HANDLER tds_fdw_handler
   VALIDATOR tds_fdw_validator;
-  
\ No newline at end of file
+  
+CREATE FUNCTION tds_fdw_estimate_cache(
+    OUT dbid oid,
+    OUT serverid oid,
+    OUT query text,
+    OUT rows float8,
+    OUT stored_at timestamptz,
+    OUT hits bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT VOLATILE;
+
+CREATE FUNCTION tds_fdw_estimate_cache_reset()
+RETURNS bigint
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT VOLATILE;
+
+-- cached queries may contain sensitive values
+REVOKE ALL ON FUNCTION tds_fdw_estimate_cache() FROM PUBLIC;
+REVOKE ALL ON FUNCTION tds_fdw_estimate_cache_reset() FROM PUBLIC;
+
+CREATE FUNCTION tds_fdw_server_stats(
+    OUT dbid oid,
+    OUT serverid oid,
+    OUT connect_ms float8,
+    OUT connects bigint,
+    OUT rtt_ms float8,
+    OUT round_trips bigint,
+    OUT rtt_sampled_at timestamptz,
+    OUT scans bigint,
+    OUT scan_startup_ms float8,
+    OUT scan_ms_per_byte float8,
+    OUT rows_fetched float8,
+    OUT bytes_fetched float8,
+    OUT bytes_per_row float8)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT VOLATILE;
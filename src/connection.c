@@ -0,0 +1,565 @@
+/*------------------------------------------------------------------
+*
+*               Foreign data wrapper for TDS (Sybase and Microsoft SQL Server)
+*
+* Author: Geoff Montee
+* Name: tds_fdw
+* File: tds_fdw/src/connection.c
+*
+* Description:
+* This is a PostgreSQL foreign data wrapper for use to connect to databases that use TDS,
+* such as Sybase databases and Microsoft SQL server.
+*
+* This foreign data wrapper requires requires a library that uses the DB-Library interface,
+* such as FreeTDS (http://www.freetds.org/). This has been tested with FreeTDS, but not
+* the proprietary implementations of DB-Library.
+*----------------------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+/* postgres headers */
+
+#include "postgres.h"
+#include "access/xact.h"
+#include "foreign/foreign.h"
+#include "miscadmin.h"
+#include "portability/instr_time.h"
+#include "storage/ipc.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+#include "utils/syscache.h"
+
+/* DB-Library headers (e.g. FreeTDS */
+#include <sybfront.h>
+#include <sybdb.h>
+
+/* #define DEBUG */
+
+#include "tds_fdw.h"
+#include "options.h"
+#include "connection.h"
+#include "server_stats.h"
+
+/*
+ * Connections are cached per backend. The key is the foreign server and the
+ * user mapping (the user mapping OID is not available before 9.6, so the
+ * user OID the mapping was looked up for is used there instead).
+ */
+typedef struct TdsFdwConnCacheKey
+{
+    Oid serverid;
+    Oid umid;
+} TdsFdwConnCacheKey;
+
+typedef struct TdsFdwConnCacheEntry
+{
+    TdsFdwConnCacheKey key;     /* hash key (must be first) */
+    List *idle;                 /* connections ready to be borrowed */
+    List *busy;                 /* connections currently borrowed */
+    uint32 server_hashvalue;    /* hash value of foreign server OID */
+    uint32 mapping_hashvalue;   /* hash value of user mapping OID */
+} TdsFdwConnCacheEntry;
+
+static HTAB *ConnectionHash = NULL;
+
+static bool dblib_initialized = false;
+
+/* state of the connection being set up, before dbsetuserdata() is done */
+static TdsFdwConnState *connecting_state = NULL;
+
+static void tdsExitDbLibrary(int code, Datum arg);
+static void tdsConnCacheInit(void);
+static DBPROCESS *tdsConnect(TdsFdwOptionSet *option_set);
+static void tdsCloseConnection(DBPROCESS *dbproc);
+static void tdsMeasureRoundTrip(DBPROCESS *dbproc, Oid serverid);
+static void tdsCloseConnectionList(List *dbprocs);
+static void tdsConnXactCallback(XactEvent event, void *arg);
+static void tdsConnInvalCallback(Datum arg, int cacheid, uint32 hashvalue);
+
+void tdsInitDbLibrary(void)
+{
+    if (dblib_initialized)
+        return;
+
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Initiating DB-Library")
+        ));
+
+    if (dbinit() == FAIL)
+    {
+        ereport(ERROR,
+            (errcode(ERRCODE_FDW_OUT_OF_MEMORY),
+                errmsg("Failed to initialize DB-Library environment")
+            ));
+    }
+
+    /*
+     * Both handlers are process-wide. tds_msg_handler() looks up the
+     * msg_handler option of each connection in its TdsFdwConnState.
+     */
+    dberrhandle(tds_err_handler);
+    dbmsghandle(tds_msg_handler);
+
+    on_proc_exit(tdsExitDbLibrary, (Datum) 0);
+
+    dblib_initialized = true;
+}
+
+static void tdsExitDbLibrary(int code, Datum arg)
+{
+    if (!dblib_initialized)
+        return;
+
+    dblib_initialized = false;
+    dbexit();
+}
+
+/* set up the connection cache the first time it is needed */
+
+static void tdsConnCacheInit(void)
+{
+    HASHCTL ctl;
+
+    tdsInitDbLibrary();
+
+    MemSet(&ctl, 0, sizeof(ctl));
+    ctl.keysize = sizeof(TdsFdwConnCacheKey);
+    ctl.entrysize = sizeof(TdsFdwConnCacheEntry);
+    ctl.hcxt = CacheMemoryContext;
+#if (PG_VERSION_NUM >= 90500)
+    ConnectionHash = hash_create("tds_fdw connections", 8, &ctl,
+                                 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+#else
+    ctl.hash = tag_hash;
+    ConnectionHash = hash_create("tds_fdw connections", 8, &ctl,
+                                 HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+#endif
+
+    RegisterXactCallback(tdsConnXactCallback, NULL);
+    CacheRegisterSyscacheCallback(FOREIGNSERVEROID,
+                                  tdsConnInvalCallback, (Datum) 0);
+    CacheRegisterSyscacheCallback(USERMAPPINGOID,
+                                  tdsConnInvalCallback, (Datum) 0);
+}
+
+DBPROCESS *tdsGetConnection(Oid serverid, TdsFdwOptionSet *option_set)
+{
+    UserMapping *user;
+    TdsFdwConnCacheKey key;
+    TdsFdwConnCacheEntry *entry;
+    DBPROCESS *dbproc;
+    MemoryContext old_cxt;
+    bool found;
+
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> starting tdsGetConnection")
+            ));
+    #endif
+
+    if (ConnectionHash == NULL)
+        tdsConnCacheInit();
+
+    user = GetUserMapping(GetUserId(), serverid);
+
+    MemSet(&key, 0, sizeof(key));
+    key.serverid = serverid;
+#if (PG_VERSION_NUM >= 90600)
+    key.umid = user->umid;
+#else
+    key.umid = user->userid;
+#endif
+
+    entry = (TdsFdwConnCacheEntry *) hash_search(ConnectionHash, &key, HASH_ENTER, &found);
+
+    if (!found)
+    {
+        entry->idle = NIL;
+        entry->busy = NIL;
+        entry->server_hashvalue =
+            GetSysCacheHashValue1(FOREIGNSERVEROID, ObjectIdGetDatum(serverid));
+#if (PG_VERSION_NUM >= 90600)
+        entry->mapping_hashvalue =
+            GetSysCacheHashValue1(USERMAPPINGOID, ObjectIdGetDatum(user->umid));
+#else
+        entry->mapping_hashvalue = 0;
+#endif
+    }
+
+    /*
+     * Take the most recently used idle connection. Idle connections that went
+     * stale or died in the meantime are thrown away.
+     */
+    dbproc = NULL;
+    while (dbproc == NULL && entry->idle != NIL)
+    {
+        dbproc = (DBPROCESS *) linitial(entry->idle);
+        entry->idle = list_delete_first(entry->idle);
+
+        if (tdsGetConnState(dbproc)->invalidated || DBDEAD(dbproc))
+        {
+            ereport(DEBUG3,
+                (errmsg("tds_fdw: Discarding %s cached connection",
+                    DBDEAD(dbproc) ? "dead" : "invalidated")
+                ));
+
+            tdsCloseConnection(dbproc);
+            dbproc = NULL;
+        }
+    }
+
+    if (dbproc != NULL)
+    {
+        ereport(DEBUG3,
+            (errmsg("tds_fdw: Reusing cached connection")
+            ));
+    }
+    else
+    {
+        /*
+         * Every cached connection is busy, e.g. with the other side of a
+         * self-join, so open another one. It stays in the cache after it is
+         * released, so the next query that needs two connections at once
+         * doesn't have to log in again.
+         */
+        instr_time start;
+        instr_time duration;
+
+        INSTR_TIME_SET_CURRENT(start);
+        dbproc = tdsConnect(option_set);
+        INSTR_TIME_SET_CURRENT(duration);
+        INSTR_TIME_SUBTRACT(duration, start);
+
+        tdsServerStatsAddConnect(serverid, INSTR_TIME_GET_MILLISEC(duration));
+    }
+
+    old_cxt = MemoryContextSwitchTo(CacheMemoryContext);
+    entry->busy = lappend(entry->busy, dbproc);
+    MemoryContextSwitchTo(old_cxt);
+
+    /* the connection is busy already, so it is closed if this fails */
+    if (tdsServerStatsRoundTripDue(serverid))
+        tdsMeasureRoundTrip(dbproc, serverid);
+
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> finishing tdsGetConnection")
+            ));
+    #endif
+
+    return dbproc;
+}
+
+void tdsReleaseConnection(DBPROCESS *dbproc)
+{
+    HASH_SEQ_STATUS scan;
+    TdsFdwConnCacheEntry *entry;
+
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> starting tdsReleaseConnection")
+            ));
+    #endif
+
+    if (dbproc == NULL)
+        return;
+
+    if (ConnectionHash != NULL)
+    {
+        hash_seq_init(&scan, ConnectionHash);
+        while ((entry = (TdsFdwConnCacheEntry *) hash_seq_search(&scan)))
+        {
+            if (!list_member_ptr(entry->busy, dbproc))
+                continue;
+
+            hash_seq_term(&scan);
+
+            /*
+             * Throw away whatever the caller didn't read, so the next user
+             * of the connection starts from a clean state. dbcancel() returns
+             * right away if nothing is pending. If it fails with an error,
+             * the connection stays busy and is closed at the end of the
+             * transaction.
+             */
+            if (!tdsGetConnState(dbproc)->invalidated && !DBDEAD(dbproc) &&
+                dbcancel(dbproc) == SUCCEED)
+            {
+                MemoryContext old_cxt;
+
+                ereport(DEBUG3,
+                    (errmsg("tds_fdw: Returning connection to the cache")
+                    ));
+
+                /* a scan with fetch_size may have turned on row buffering */
+                dbclropt(dbproc, DBBUFFER, NULL);
+
+                entry->busy = list_delete_ptr(entry->busy, dbproc);
+                old_cxt = MemoryContextSwitchTo(CacheMemoryContext);
+                entry->idle = lcons(dbproc, entry->idle);
+                MemoryContextSwitchTo(old_cxt);
+
+                return;
+            }
+
+            entry->busy = list_delete_ptr(entry->busy, dbproc);
+            break;
+        }
+    }
+
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Closing database connection")
+        ));
+
+    tdsCloseConnection(dbproc);
+
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> finishing tdsReleaseConnection")
+            ));
+    #endif
+}
+
+void tdsDiscardConnection(DBPROCESS *dbproc)
+{
+    if (dbproc == NULL)
+        return;
+
+    /* an invalidated connection is closed when it is released */
+    tdsGetConnState(dbproc)->invalidated = true;
+    tdsReleaseConnection(dbproc);
+}
+
+/* open a new connection for a cache entry */
+
+static DBPROCESS *tdsConnect(TdsFdwOptionSet *option_set)
+{
+    LOGINREC *login;
+    DBPROCESS *dbproc = NULL;
+    TdsFdwConnState *state;
+
+    state = (TdsFdwConnState *) MemoryContextAllocZero(CacheMemoryContext, sizeof(TdsFdwConnState));
+    state->msg_handler = tds_blackhole_msg_handler;
+
+    if (option_set->msg_handler)
+    {
+        if (strcmp(option_set->msg_handler, "notice") == 0)
+        {
+            state->msg_handler = tds_notice_msg_handler;
+        }
+        
+        else if (strcmp(option_set->msg_handler, "blackhole") == 0)
+        {
+            state->msg_handler = tds_blackhole_msg_handler;
+        }
+        
+        else
+        {
+            pfree(state);
+            ereport(ERROR,
+                (errcode(ERRCODE_SYNTAX_ERROR),
+                    errmsg("Unknown msg handler: %s.", option_set->msg_handler)
+                ));
+        }
+    }
+
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Getting login structure")
+        ));
+
+    if ((login = dblogin()) == NULL)
+    {
+        pfree(state);
+        ereport(ERROR,
+            (errcode(ERRCODE_FDW_OUT_OF_MEMORY),
+                errmsg("Failed to initialize DB-Library login structure")
+            ));
+    }
+
+    /*
+     * dbopen() copies what it needs from the login structure, so it can be
+     * freed right away. Don't leak the connection if anything after dbopen()
+     * fails.
+     */
+    connecting_state = state;
+
+    PG_TRY();
+    {
+        tdsSetupConnection(option_set, login, &dbproc);
+    }
+    PG_CATCH();
+    {
+        connecting_state = NULL;
+
+        if (dbproc != NULL)
+            dbclose(dbproc);
+
+        dbloginfree(login);
+        pfree(state);
+        PG_RE_THROW();
+    }
+    PG_END_TRY();
+
+    connecting_state = NULL;
+    dbloginfree(login);
+
+    dbsetuserdata(dbproc, (BYTE *) state);
+
+    return dbproc;
+}
+
+/*
+ * Measure the round trip time to the server with a query that costs the
+ * server next to nothing, for the planner's network costs.
+ */
+
+static void tdsMeasureRoundTrip(DBPROCESS *dbproc, Oid serverid)
+{
+    instr_time start;
+    instr_time duration;
+    RETCODE erc;
+
+    INSTR_TIME_SET_CURRENT(start);
+
+    if (dbcmd(dbproc, "SELECT 1") == FAIL || dbsqlexec(dbproc) == FAIL)
+        return;
+
+    while ((erc = dbresults(dbproc)) == SUCCEED)
+    {
+        while (dbnextrow(dbproc) == REG_ROW)
+            ;
+    }
+
+    if (erc == FAIL)
+        return;
+
+    INSTR_TIME_SET_CURRENT(duration);
+    INSTR_TIME_SUBTRACT(duration, start);
+
+    tdsServerStatsAddRoundTrip(serverid, INSTR_TIME_GET_MILLISEC(duration));
+}
+
+/* close a connection and free its state */
+
+static void tdsCloseConnection(DBPROCESS *dbproc)
+{
+    TdsFdwConnState *state = (TdsFdwConnState *) dbgetuserdata(dbproc);
+
+    dbclose(dbproc);
+
+    if (state != NULL)
+        pfree(state);
+}
+
+bool tdsHaveCachedConnection(Oid serverid)
+{
+    HASH_SEQ_STATUS scan;
+    TdsFdwConnCacheEntry *entry;
+    bool found = false;
+
+    if (ConnectionHash == NULL)
+        return false;
+
+    hash_seq_init(&scan, ConnectionHash);
+    while ((entry = (TdsFdwConnCacheEntry *) hash_seq_search(&scan)))
+    {
+        if (entry->key.serverid == serverid && entry->idle != NIL)
+        {
+            hash_seq_term(&scan);
+            found = true;
+            break;
+        }
+    }
+
+    return found;
+}
+
+TdsFdwConnState *tdsGetConnState(DBPROCESS *dbproc)
+{
+    TdsFdwConnState *state = NULL;
+
+    if (dbproc != NULL)
+        state = (TdsFdwConnState *) dbgetuserdata(dbproc);
+
+    return state != NULL ? state : connecting_state;
+}
+
+/* close all connections in a list */
+
+static void tdsCloseConnectionList(List *dbprocs)
+{
+    ListCell *lc;
+
+    foreach(lc, dbprocs)
+        tdsCloseConnection((DBPROCESS *) lfirst(lc));
+
+    list_free(dbprocs);
+}
+
+/*
+ * At the end of the transaction every connection should have been released.
+ * If one is still busy, its scan was aborted half way and the state of the
+ * connection is unknown, so it is closed rather than reused.
+ */
+static void tdsConnXactCallback(XactEvent event, void *arg)
+{
+    HASH_SEQ_STATUS scan;
+    TdsFdwConnCacheEntry *entry;
+
+    switch (event)
+    {
+        case XACT_EVENT_COMMIT:
+        case XACT_EVENT_ABORT:
+        case XACT_EVENT_PREPARE:
+#if (PG_VERSION_NUM >= 90500)
+        case XACT_EVENT_PARALLEL_COMMIT:
+        case XACT_EVENT_PARALLEL_ABORT:
+#endif
+            break;
+        default:
+            return;
+    }
+
+    hash_seq_init(&scan, ConnectionHash);
+    while ((entry = (TdsFdwConnCacheEntry *) hash_seq_search(&scan)))
+    {
+        tdsCloseConnectionList(entry->busy);
+        entry->busy = NIL;
+    }
+}
+
+/*
+ * Connection options come from the foreign server and the user mapping, so
+ * a change to either one means the connection has to be made again.
+ * Connections are only marked here; idle ones are closed the next time they
+ * would be borrowed and busy ones once they are released.
+ */
+static void tdsConnInvalCallback(Datum arg, int cacheid, uint32 hashvalue)
+{
+    HASH_SEQ_STATUS scan;
+    TdsFdwConnCacheEntry *entry;
+
+    Assert(cacheid == FOREIGNSERVEROID || cacheid == USERMAPPINGOID);
+
+    hash_seq_init(&scan, ConnectionHash);
+    while ((entry = (TdsFdwConnCacheEntry *) hash_seq_search(&scan)))
+    {
+        ListCell *lc;
+
+        if (hashvalue == 0 ||
+            (cacheid == FOREIGNSERVEROID &&
+             entry->server_hashvalue == hashvalue) ||
+            (cacheid == USERMAPPINGOID &&
+             (entry->mapping_hashvalue == 0 ||
+              entry->mapping_hashvalue == hashvalue)))
+        {
+            foreach(lc, entry->idle)
+                tdsGetConnState((DBPROCESS *) lfirst(lc))->invalidated = true;
+
+            foreach(lc, entry->busy)
+                tdsGetConnState((DBPROCESS *) lfirst(lc))->invalidated = true;
+        }
+    }
+}
@@ -0,0 +1,486 @@
+/*------------------------------------------------------------------
+*
+*               Foreign data wrapper for TDS (Sybase and Microsoft SQL Server)
+*
+* Author: Geoff Montee
+* Name: tds_fdw
+* File: tds_fdw/src/estimate_cache.c
+*
+* Description:
+* This is a PostgreSQL foreign data wrapper for use to connect to databases that use TDS,
+* such as Sybase databases and Microsoft SQL server.
+*
+* This foreign data wrapper requires requires a library that uses the DB-Library interface,
+* such as FreeTDS (http://www.freetds.org/). This has been tested with FreeTDS, but not
+* the proprietary implementations of DB-Library.
+*----------------------------------------------------------------------------
+*/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Override PGDLLEXPORT for visibility */
+
+#include "visibility.h"
+
+/* postgres headers */
+
+#include "postgres.h"
+#include "funcapi.h"
+#include "foreign/foreign.h"
+#if (PG_VERSION_NUM >= 130000)
+#include "common/hashfn.h"
+#elif (PG_VERSION_NUM >= 120000)
+#include "utils/hashutils.h"
+#else
+#include "access/hash.h"
+#endif
+#include "miscadmin.h"
+#include "nodes/execnodes.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
+
+/* #define DEBUG */
+
+#include "estimate_cache.h"
+
+/* GUCs */
+
+static const int DEFAULT_ESTIMATE_CACHE_TTL = 60;
+static int estimate_cache_ttl = 60;
+
+static const int DEFAULT_ESTIMATE_CACHE_MAX_ENTRIES = 1024;
+static int estimate_cache_max_entries = 1024;
+
+/*
+ * The remote login can see other rows, so estimates are kept per user
+ * mapping, like connections (see connection.c). Entries whose key matches
+ * are also compared by the whole normalized query.
+ */
+typedef struct TdsFdwEstimateCacheKey
+{
+    Oid dbid;
+    Oid serverid;
+    Oid umid;                   /* user mapping, or user before 9.6 */
+    uint32 query_len;           /* length of the normalized query */
+    uint64 query_hash;          /* hash of the normalized query */
+} TdsFdwEstimateCacheKey;
+
+typedef struct TdsFdwEstimateCacheEntry
+{
+    TdsFdwEstimateCacheKey key; /* hash key (must be first) */
+    double rows;
+    TimestampTz stored_at;
+    int64 hits;
+    char query[TDS_ESTIMATE_CACHE_QUERY_LEN + 1];   /* normalized query */
+} TdsFdwEstimateCacheEntry;
+
+/* the cache is shared if this backend attached to shared memory */
+static HTAB *estimate_hash = NULL;
+static LWLock *estimate_lock = NULL;
+
+#ifdef TDS_SHARED_ESTIMATE_CACHE
+#if (PG_VERSION_NUM >= 150000)
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+static void tdsEstimateCacheShmemRequest(void);
+static void tdsEstimateCacheShmemStartup(void);
+static Size tdsEstimateCacheShmemSize(void);
+#endif
+
+static HTAB *tdsEstimateCacheHash(void);
+static void tdsEstimateCacheLock(LWLockMode mode);
+static void tdsEstimateCacheUnlock(void);
+static char *tdsNormalizeQuery(const char *query);
+static void tdsEstimateCacheMakeKey(TdsFdwEstimateCacheKey *key, Oid serverid, const char *query);
+
+PG_FUNCTION_INFO_V1(tds_fdw_estimate_cache);
+PG_FUNCTION_INFO_V1(tds_fdw_estimate_cache_reset);
+
+void tdsEstimateCacheInit(void)
+{
+    DefineCustomIntVariable("tds_fdw.estimate_cache_ttl",
+        "Time to live of cached remote row estimates",
+        "Remote row estimates are reused for this many seconds. Set to 0 to disable the cache",
+        &estimate_cache_ttl,
+        DEFAULT_ESTIMATE_CACHE_TTL,
+        0,
+        INT_MAX,
+        PGC_USERSET,
+        GUC_UNIT_S,
+        NULL,
+        NULL,
+        NULL);
+
+    DefineCustomIntVariable("tds_fdw.estimate_cache_max_entries",
+        "Maximum number of cached remote row estimates",
+        "When the cache is full, the oldest estimate is evicted",
+        &estimate_cache_max_entries,
+        DEFAULT_ESTIMATE_CACHE_MAX_ENTRIES,
+        16,
+        INT_MAX / 2,
+        PGC_POSTMASTER,
+        0,
+        NULL,
+        NULL,
+        NULL);
+
+#ifdef TDS_SHARED_ESTIMATE_CACHE
+    if (!process_shared_preload_libraries_in_progress)
+        return;
+
+#if (PG_VERSION_NUM >= 150000)
+    prev_shmem_request_hook = shmem_request_hook;
+    shmem_request_hook = tdsEstimateCacheShmemRequest;
+#else
+    tdsEstimateCacheShmemRequest();
+#endif
+    prev_shmem_startup_hook = shmem_startup_hook;
+    shmem_startup_hook = tdsEstimateCacheShmemStartup;
+#endif
+}
+
+#ifdef TDS_SHARED_ESTIMATE_CACHE
+
+static Size tdsEstimateCacheShmemSize(void)
+{
+    return hash_estimate_size(estimate_cache_max_entries,
+                              sizeof(TdsFdwEstimateCacheEntry));
+}
+
+static void tdsEstimateCacheShmemRequest(void)
+{
+#if (PG_VERSION_NUM >= 150000)
+    if (prev_shmem_request_hook)
+        prev_shmem_request_hook();
+#endif
+
+    RequestAddinShmemSpace(tdsEstimateCacheShmemSize());
+    RequestNamedLWLockTranche("tds_fdw", 1);
+}
+
+static void tdsEstimateCacheShmemStartup(void)
+{
+    HASHCTL ctl;
+
+    if (prev_shmem_startup_hook)
+        prev_shmem_startup_hook();
+
+    MemSet(&ctl, 0, sizeof(ctl));
+    ctl.keysize = sizeof(TdsFdwEstimateCacheKey);
+    ctl.entrysize = sizeof(TdsFdwEstimateCacheEntry);
+
+    LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+    estimate_lock = &(GetNamedLWLockTranche("tds_fdw"))->lock;
+    estimate_hash = ShmemInitHash("tds_fdw estimate cache",
+                                  estimate_cache_max_entries,
+                                  estimate_cache_max_entries,
+                                  &ctl,
+                                  HASH_ELEM | HASH_BLOBS);
+
+    LWLockRelease(AddinShmemInitLock);
+}
+
+#endif  /* TDS_SHARED_ESTIMATE_CACHE */
+
+/*
+ * Get the cache. Without shared memory, fall back to a cache that is local
+ * to this backend, so repeated plans in one session still benefit.
+ */
+static HTAB *tdsEstimateCacheHash(void)
+{
+    if (estimate_hash == NULL)
+    {
+        HASHCTL ctl;
+
+        MemSet(&ctl, 0, sizeof(ctl));
+        ctl.keysize = sizeof(TdsFdwEstimateCacheKey);
+        ctl.entrysize = sizeof(TdsFdwEstimateCacheEntry);
+        ctl.hcxt = TopMemoryContext;
+#if (PG_VERSION_NUM >= 90500)
+        estimate_hash = hash_create("tds_fdw estimate cache", 64, &ctl,
+                                    HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+#else
+        ctl.hash = tag_hash;
+        estimate_hash = hash_create("tds_fdw estimate cache", 64, &ctl,
+                                    HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+#endif
+    }
+
+    return estimate_hash;
+}
+
+static void tdsEstimateCacheLock(LWLockMode mode)
+{
+    if (estimate_lock != NULL)
+        LWLockAcquire(estimate_lock, mode);
+}
+
+static void tdsEstimateCacheUnlock(void)
+{
+    if (estimate_lock != NULL)
+        LWLockRelease(estimate_lock);
+}
+
+/*
+ * Collapse runs of whitespace outside of quotes into a single space, so
+ * queries that differ only in formatting share an entry.
+ */
+static char *tdsNormalizeQuery(const char *query)
+{
+    char *normalized = palloc(strlen(query) + 1);
+    char *out = normalized;
+    char quote = '\0';
+    const char *p;
+
+    for (p = query; *p != '\0'; p++)
+    {
+        if (quote != '\0')
+        {
+            if (*p == quote)
+                quote = '\0';
+        }
+        else if (*p == '\'' || *p == '"')
+            quote = *p;
+        else if (isspace((unsigned char) *p))
+        {
+            if (out != normalized && out[-1] != ' ')
+                *out++ = ' ';
+            continue;
+        }
+
+        *out++ = *p;
+    }
+
+    if (out != normalized && out[-1] == ' ')
+        out--;
+
+    *out = '\0';
+
+    return normalized;
+}
+
+static void tdsEstimateCacheMakeKey(TdsFdwEstimateCacheKey *key, Oid serverid, const char *query)
+{
+    UserMapping *user = GetUserMapping(GetUserId(), serverid);
+
+    MemSet(key, 0, sizeof(TdsFdwEstimateCacheKey));
+    key->dbid = MyDatabaseId;
+    key->serverid = serverid;
+#if (PG_VERSION_NUM >= 90600)
+    key->umid = user->umid;
+#else
+    key->umid = user->userid;
+#endif
+    key->query_len = strlen(query);
+#if (PG_VERSION_NUM >= 110000)
+    key->query_hash = DatumGetUInt64(hash_any_extended((const unsigned char *) query, key->query_len, 0));
+#else
+    key->query_hash = DatumGetUInt32(hash_any((const unsigned char *) query, key->query_len));
+#endif
+}
+
+bool tdsEstimateCacheLookup(Oid serverid, const char *query, bool allow_stale, double *rows)
+{
+    TdsFdwEstimateCacheKey key;
+    TdsFdwEstimateCacheEntry *entry;
+    char *normalized;
+    bool found = false;
+
+    if (estimate_cache_ttl <= 0)
+        return false;
+
+    normalized = tdsNormalizeQuery(query);
+    tdsEstimateCacheMakeKey(&key, serverid, normalized);
+
+    tdsEstimateCacheLock(LW_EXCLUSIVE);
+
+    entry = (TdsFdwEstimateCacheEntry *) hash_search(tdsEstimateCacheHash(), &key, HASH_FIND, NULL);
+
+    /* a different query with the same hash is a miss */
+    if (entry != NULL && strcmp(entry->query, normalized) == 0 &&
+        (allow_stale ||
+         !TimestampDifferenceExceeds(entry->stored_at, GetCurrentTimestamp(),
+                                     estimate_cache_ttl * 1000)))
+    {
+        entry->hits++;
+        *rows = entry->rows;
+        found = true;
+    }
+
+    tdsEstimateCacheUnlock();
+
+    pfree(normalized);
+
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Estimate cache %s for query %s", found ? "hit" : "miss", query)
+        ));
+
+    return found;
+}
+
+void tdsEstimateCacheStore(Oid serverid, const char *query, double rows)
+{
+    TdsFdwEstimateCacheKey key;
+    TdsFdwEstimateCacheEntry *entry;
+    HTAB *hash;
+    char *normalized;
+    bool found;
+
+    if (estimate_cache_ttl <= 0)
+        return;
+
+    normalized = tdsNormalizeQuery(query);
+
+    /* only whole queries are kept, so that they can be compared */
+    if (strlen(normalized) > TDS_ESTIMATE_CACHE_QUERY_LEN)
+    {
+        ereport(DEBUG3,
+            (errmsg("tds_fdw: Query is too long for the estimate cache: %s", query)
+            ));
+
+        pfree(normalized);
+        return;
+    }
+
+    tdsEstimateCacheMakeKey(&key, serverid, normalized);
+
+    tdsEstimateCacheLock(LW_EXCLUSIVE);
+
+    hash = tdsEstimateCacheHash();
+
+    /* make room by evicting the oldest entry */
+    if (hash_search(hash, &key, HASH_FIND, NULL) == NULL &&
+        hash_get_num_entries(hash) >= estimate_cache_max_entries)
+    {
+        HASH_SEQ_STATUS scan;
+        TdsFdwEstimateCacheEntry *oldest = NULL;
+
+        hash_seq_init(&scan, hash);
+        while ((entry = (TdsFdwEstimateCacheEntry *) hash_seq_search(&scan)))
+        {
+            if (oldest == NULL || entry->stored_at < oldest->stored_at)
+                oldest = entry;
+        }
+
+        if (oldest != NULL)
+            hash_search(hash, &oldest->key, HASH_REMOVE, NULL);
+    }
+
+    /* HASH_ENTER_NULL is only allowed for the shared table */
+    entry = (TdsFdwEstimateCacheEntry *) hash_search(hash, &key,
+        estimate_lock != NULL ? HASH_ENTER_NULL : HASH_ENTER, &found);
+
+    if (entry != NULL)
+    {
+        /* a different query with the same hash is replaced */
+        if (!found || strcmp(entry->query, normalized) != 0)
+            entry->hits = 0;
+
+        entry->rows = rows;
+        entry->stored_at = GetCurrentTimestamp();
+        memcpy(entry->query, normalized, key.query_len + 1);
+    }
+
+    tdsEstimateCacheUnlock();
+
+    pfree(normalized);
+}
+
+/* list the cached estimates */
+
+PGDLLEXPORT Datum tds_fdw_estimate_cache(PG_FUNCTION_ARGS)
+{
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+    TupleDesc tupdesc;
+    Tuplestorestate *tupstore;
+    MemoryContext per_query_ctx;
+    MemoryContext old_cxt;
+    HASH_SEQ_STATUS scan;
+    TdsFdwEstimateCacheEntry *entry;
+
+    if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+        ereport(ERROR,
+            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                errmsg("set-valued function called in context that cannot accept a set")
+            ));
+
+    if (!(rsinfo->allowedModes & SFRM_Materialize))
+        ereport(ERROR,
+            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                errmsg("materialize mode required, but it is not allowed in this context")
+            ));
+
+    per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+    old_cxt = MemoryContextSwitchTo(per_query_ctx);
+
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+        elog(ERROR, "return type must be a row type");
+
+    tupstore = tuplestore_begin_heap(true, false, work_mem);
+    rsinfo->returnMode = SFRM_Materialize;
+    rsinfo->setResult = tupstore;
+    rsinfo->setDesc = tupdesc;
+
+    MemoryContextSwitchTo(old_cxt);
+
+    tdsEstimateCacheLock(LW_SHARED);
+
+    hash_seq_init(&scan, tdsEstimateCacheHash());
+    while ((entry = (TdsFdwEstimateCacheEntry *) hash_seq_search(&scan)))
+    {
+        Datum values[6];
+        bool nulls[6];
+
+        MemSet(nulls, 0, sizeof(nulls));
+
+        values[0] = ObjectIdGetDatum(entry->key.dbid);
+        values[1] = ObjectIdGetDatum(entry->key.serverid);
+        values[2] = CStringGetTextDatum(entry->query);
+        values[3] = Float8GetDatum(entry->rows);
+        values[4] = TimestampTzGetDatum(entry->stored_at);
+        values[5] = Int64GetDatum(entry->hits);
+
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+
+    tdsEstimateCacheUnlock();
+
+    return (Datum) 0;
+}
+
+/* remove all cached estimates, returns the number of entries removed */
+
+PGDLLEXPORT Datum tds_fdw_estimate_cache_reset(PG_FUNCTION_ARGS)
+{
+    HASH_SEQ_STATUS scan;
+    TdsFdwEstimateCacheEntry *entry;
+    HTAB *hash;
+    int64 removed = 0;
+
+    tdsEstimateCacheLock(LW_EXCLUSIVE);
+
+    hash = tdsEstimateCacheHash();
+
+    hash_seq_init(&scan, hash);
+    while ((entry = (TdsFdwEstimateCacheEntry *) hash_seq_search(&scan)))
+    {
+        hash_search(hash, &entry->key, HASH_REMOVE, NULL);
+        removed++;
+    }
+
+    tdsEstimateCacheUnlock();
+
+    PG_RETURN_INT64(removed);
+}
@@ -60,6 +60,11 @@ static struct TdsFdwOption valid_options[] =
     { "tds_version",            ForeignServerRelationId },
     { "msg_handler",            ForeignServerRelationId },
     { "row_estimate_method",    ForeignServerRelationId },
+    { "analyze_method",         ForeignServerRelationId },
+    { "estimate_timeout",       ForeignServerRelationId },
+    { "fetch_size",             ForeignServerRelationId },
+    { "async_capable",          ForeignServerRelationId },
+    { "early_dispatch",         ForeignServerRelationId },
     { "use_remote_estimate",    ForeignServerRelationId },
     { "fdw_startup_cost",       ForeignServerRelationId },
     { "fdw_tuple_cost",         ForeignServerRelationId },
@@ -70,6 +75,14 @@ static struct TdsFdwOption valid_options[] =
     { "schema_name",            ForeignTableRelationId },
     { "table_name",             ForeignTableRelationId },
     { "row_estimate_method",    ForeignTableRelationId },
+    { "analyze_method",         ForeignTableRelationId },
+    { "estimate_timeout",       ForeignTableRelationId },
+    { "fetch_size",             ForeignTableRelationId },
+    { "async_capable",          ForeignTableRelationId },
+    { "early_dispatch",         ForeignTableRelationId },
+    { "max_lob_size",           ForeignTableRelationId },
+    { "truncate_lobs",          ForeignTableRelationId },
+    { "partition_column",       ForeignTableRelationId },
     { "match_column_names",     ForeignTableRelationId },
     { "use_remote_estimate",    ForeignTableRelationId },
     { "local_tuple_estimate",   ForeignTableRelationId },
@@ -89,6 +102,11 @@ static struct TdsFdwOptionSource option_sources[] =
     { "tds_version",            UNSET },
     { "msg_handler",            UNSET },
     { "row_estimate_method",    UNSET },
+    { "analyze_method",         UNSET },
+    { "estimate_timeout",       UNSET },
+    { "fetch_size",             UNSET },
+    { "async_capable",          UNSET },
+    { "early_dispatch",         UNSET },
     { "use_remote_estimate",    UNSET },
     { "fdw_startup_cost",       UNSET },
     { "fdw_tuple_cost",         UNSET },
@@ -99,6 +117,14 @@ static struct TdsFdwOptionSource option_sources[] =
     { "schema_name",            UNSET },
     { "table_name",             UNSET },
     { "row_estimate_method",    UNSET },
+    { "analyze_method",         UNSET },
+    { "estimate_timeout",       UNSET },
+    { "fetch_size",             UNSET },
+    { "async_capable",          UNSET },
+    { "early_dispatch",         UNSET },
+    { "max_lob_size",           UNSET },
+    { "truncate_lobs",          UNSET },
+    { "partition_column",       UNSET },
     { "match_column_names",     UNSET },
     { "use_remote_estimate",    UNSET },
     { "local_tuple_estimate",   UNSET },
@@ -115,6 +141,10 @@ static const char *DEFAULT_SERVERNAME = "127.0.0.1";
 
 static const char *DEFAULT_ROW_ESTIMATE_METHOD = "execute";
 
+/* default method to use to collect statistics for ANALYZE */
+
+static const char *DEFAULT_ANALYZE_METHOD = "sample";
+
 /* default function used to handle TDS messages */
 
 static const char *DEFAULT_MSG_HANDLER = "blackhole";
@@ -139,6 +169,30 @@ static const int DEFAULT_FDW_TUPLE_COST = 100;
 
 static const int DEFAULT_LOCAL_TUPLE_ESTIMATE = 1000;
 
+/* default time limit for remote estimates, in seconds (0 means no limit) */
+
+static const int DEFAULT_ESTIMATE_TIMEOUT = 0;
+
+/* default number of rows fetched at a time (1 means no row buffering) */
+
+static const int DEFAULT_FETCH_SIZE = 1;
+
+/* by default, scans under an Append node run one after another */
+
+static const int DEFAULT_ASYNC_CAPABLE = 0;
+
+/* by default, the query of a scan is sent when the first row is needed */
+
+static const int DEFAULT_EARLY_DISPATCH = 0;
+
+/* default limit for text and image values, in bytes (0 means no limit) */
+
+static const int DEFAULT_MAX_LOB_SIZE = 0;
+
+/* by default, values longer than max_lob_size are an error */
+
+static const int DEFAULT_TRUNCATE_LOBS = 0;
+
 void tdsValidateOptions(List *options_list, Oid context, TdsFdwOptionSet* option_set)
 {
     #ifdef DEBUG
@@ -484,6 +538,8 @@ void tdsGetForeignServerOptions(List *options_list, TdsFdwOptionSet *option_set)
             
             if (IsA(def->arg, Integer))
                 option_set->fdw_startup_cost = defGetInt64(def); 
+            else if (strcmp(defGetString(def), "auto") == 0)
+                option_set->fdw_startup_cost = TDS_AUTO_COST;
             else
                 option_set->fdw_startup_cost = atoi(defGetString(def));
 
@@ -500,6 +556,8 @@ void tdsGetForeignServerOptions(List *options_list, TdsFdwOptionSet *option_set)
                    
             if (IsA(def->arg, Integer))
                 option_set->fdw_tuple_cost = defGetInt64(def);
+            else if (strcmp(defGetString(def), "auto") == 0)
+                option_set->fdw_tuple_cost = TDS_AUTO_COST;
             else
                 option_set->fdw_tuple_cost = atoi(defGetString(def));
 
@@ -567,11 +625,113 @@ void tdsGetForeignServerTableOptions(List *options_list, TdsFdwOptionSet *option
             tdsUpdateOptionSource(def->defname, FOREIGN_SERVER);
             
             if ((strcmp(option_set->row_estimate_method, "execute") != 0)
-                && (strcmp(option_set->row_estimate_method, "showplan_all") != 0))
+                && (strcmp(option_set->row_estimate_method, "showplan_all") != 0)
+                && (strcmp(option_set->row_estimate_method, "partition_stats") != 0))
             {
                 ereport(ERROR,
                     (errcode(ERRCODE_SYNTAX_ERROR),
-                        errmsg("row_estimate_method should be set to \"execute\" or \"showplan_all\". Currently set to %s", option_set->row_estimate_method)
+                        errmsg("row_estimate_method should be set to \"execute\", \"showplan_all\" or \"partition_stats\". Currently set to %s", option_set->row_estimate_method)
+                    ));
+            }
+        }
+        
+        else if (strcmp(def->defname, "estimate_timeout") == 0)
+        {
+            if (source == FOREIGN_SERVER)
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("Redundant option: estimate_timeout (%s)", defGetString(def))
+                    ));
+
+            if (IsA(def->arg, Integer))
+                option_set->estimate_timeout = defGetInt64(def);
+            else
+                option_set->estimate_timeout = atoi(defGetString(def));
+
+            tdsUpdateOptionSource(def->defname, FOREIGN_SERVER);
+
+            if (option_set->estimate_timeout < 0)
+            {
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("estimate_timeout should be a number of seconds, or 0 for no limit. Currently set to %s", defGetString(def))
+                    ));
+            }
+        }
+
+        else if (strcmp(def->defname, "fetch_size") == 0)
+        {
+            if (source == FOREIGN_SERVER)
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("Redundant option: fetch_size (%s)", defGetString(def))
+                    ));
+
+            if (IsA(def->arg, Integer))
+                option_set->fetch_size = defGetInt64(def);
+            else
+                option_set->fetch_size = atoi(defGetString(def));
+
+            tdsUpdateOptionSource(def->defname, FOREIGN_SERVER);
+
+            if (option_set->fetch_size < 1)
+            {
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("fetch_size should be a number of rows greater than 0. Currently set to %s", defGetString(def))
+                    ));
+            }
+        }
+
+        else if (strcmp(def->defname, "async_capable") == 0)
+        {
+            if (source == FOREIGN_SERVER)
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("Redundant option: async_capable (%s)", defGetString(def))
+                    ));
+
+            if (IsA(def->arg, Integer))
+                option_set->async_capable = defGetBoolean(def);
+            else
+                parse_bool(defGetString(def), &option_set->async_capable);
+
+            tdsUpdateOptionSource(def->defname, FOREIGN_SERVER);
+        }
+
+        else if (strcmp(def->defname, "early_dispatch") == 0)
+        {
+            if (source == FOREIGN_SERVER)
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("Redundant option: early_dispatch (%s)", defGetString(def))
+                    ));
+
+            if (IsA(def->arg, Integer))
+                option_set->early_dispatch = defGetBoolean(def);
+            else
+                parse_bool(defGetString(def), &option_set->early_dispatch);
+
+            tdsUpdateOptionSource(def->defname, FOREIGN_SERVER);
+        }
+        
+        else if (strcmp(def->defname, "analyze_method") == 0)
+        {   
+            if (option_set->analyze_method && source == FOREIGN_SERVER)
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("Redundant option: analyze_method (%s)", defGetString(def))
+                    ));
+                    
+            option_set->analyze_method = defGetString(def);
+            tdsUpdateOptionSource(def->defname, FOREIGN_SERVER);
+            
+            if ((strcmp(option_set->analyze_method, "sample") != 0)
+                && (strcmp(option_set->analyze_method, "histogram") != 0))
+            {
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("analyze_method should be set to \"sample\" or \"histogram\". Currently set to %s", option_set->analyze_method)
                     ));
             }
         }
@@ -690,15 +850,171 @@ void tdsGetForeignTableOptions(List *options_list, TdsFdwOptionSet *option_set)
             tdsUpdateOptionSource(def->defname, FOREIGN_TABLE);
             
             if ((strcmp(option_set->row_estimate_method, "execute") != 0)
-                && (strcmp(option_set->row_estimate_method, "showplan_all") != 0))
+                && (strcmp(option_set->row_estimate_method, "showplan_all") != 0)
+                && (strcmp(option_set->row_estimate_method, "partition_stats") != 0))
+            {
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("row_estimate_method should be set to \"execute\", \"showplan_all\" or \"partition_stats\". Currently set to %s", option_set->row_estimate_method)
+                    ));
+            }
+        }
+
+        else if (strcmp(def->defname, "estimate_timeout") == 0)
+        {
+            if (source == FOREIGN_TABLE)
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("Redundant option: estimate_timeout (%s)", defGetString(def))
+                    ));
+
+            if (IsA(def->arg, Integer))
+                option_set->estimate_timeout = defGetInt64(def);
+            else
+                option_set->estimate_timeout = atoi(defGetString(def));
+
+            tdsUpdateOptionSource(def->defname, FOREIGN_TABLE);
+
+            if (option_set->estimate_timeout < 0)
+            {
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("estimate_timeout should be a number of seconds, or 0 for no limit. Currently set to %s", defGetString(def))
+                    ));
+            }
+        }
+
+        else if (strcmp(def->defname, "fetch_size") == 0)
+        {
+            if (source == FOREIGN_TABLE)
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("Redundant option: fetch_size (%s)", defGetString(def))
+                    ));
+
+            if (IsA(def->arg, Integer))
+                option_set->fetch_size = defGetInt64(def);
+            else
+                option_set->fetch_size = atoi(defGetString(def));
+
+            tdsUpdateOptionSource(def->defname, FOREIGN_TABLE);
+
+            if (option_set->fetch_size < 1)
+            {
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("fetch_size should be a number of rows greater than 0. Currently set to %s", defGetString(def))
+                    ));
+            }
+        }
+
+        else if (strcmp(def->defname, "async_capable") == 0)
+        {
+            if (source == FOREIGN_TABLE)
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("Redundant option: async_capable (%s)", defGetString(def))
+                    ));
+
+            if (IsA(def->arg, Integer))
+                option_set->async_capable = defGetBoolean(def);
+            else
+                parse_bool(defGetString(def), &option_set->async_capable);
+
+            tdsUpdateOptionSource(def->defname, FOREIGN_TABLE);
+        }
+
+        else if (strcmp(def->defname, "early_dispatch") == 0)
+        {
+            if (source == FOREIGN_TABLE)
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("Redundant option: early_dispatch (%s)", defGetString(def))
+                    ));
+
+            if (IsA(def->arg, Integer))
+                option_set->early_dispatch = defGetBoolean(def);
+            else
+                parse_bool(defGetString(def), &option_set->early_dispatch);
+
+            tdsUpdateOptionSource(def->defname, FOREIGN_TABLE);
+        }
+
+        else if (strcmp(def->defname, "max_lob_size") == 0)
+        {
+            if (source == FOREIGN_TABLE)
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("Redundant option: max_lob_size (%s)", defGetString(def))
+                    ));
+
+            if (IsA(def->arg, Integer))
+                option_set->max_lob_size = defGetInt64(def);
+            else
+                option_set->max_lob_size = atoi(defGetString(def));
+
+            tdsUpdateOptionSource(def->defname, FOREIGN_TABLE);
+
+            /* max_lob_size * 2 + 2 bytes are asked for, see tdsSendQuery() */
+            if (option_set->max_lob_size < 0 || option_set->max_lob_size > (INT_MAX - 2) / 2)
             {
                 ereport(ERROR,
                     (errcode(ERRCODE_SYNTAX_ERROR),
-                        errmsg("row_estimate_method should be set to \"execute\" or \"showplan_all\". Currently set to %s", option_set->row_estimate_method)
+                        errmsg("max_lob_size should be a number of bytes up to %d, or 0 for no limit. Currently set to %s",
+                            (INT_MAX - 2) / 2, defGetString(def))
                     ));
             }
         }
 
+        else if (strcmp(def->defname, "truncate_lobs") == 0)
+        {
+            if (source == FOREIGN_TABLE)
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("Redundant option: truncate_lobs (%s)", defGetString(def))
+                    ));
+
+            if (IsA(def->arg, Integer))
+                option_set->truncate_lobs = defGetBoolean(def);
+            else
+                parse_bool(defGetString(def), &option_set->truncate_lobs);
+
+            tdsUpdateOptionSource(def->defname, FOREIGN_TABLE);
+        }
+
+        else if (strcmp(def->defname, "partition_column") == 0)
+        {
+            if (option_set->partition_column && source == FOREIGN_TABLE)
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("Redundant option: partition_column (%s)", defGetString(def))
+                    ));
+
+            option_set->partition_column = defGetString(def);
+            tdsUpdateOptionSource(def->defname, FOREIGN_TABLE);
+        }
+        
+        else if (strcmp(def->defname, "analyze_method") == 0)
+        {   
+            if (option_set->analyze_method && source == FOREIGN_TABLE)
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("Redundant option: analyze_method (%s)", defGetString(def))
+                    ));
+                    
+            option_set->analyze_method = defGetString(def);
+            tdsUpdateOptionSource(def->defname, FOREIGN_TABLE);
+            
+            if ((strcmp(option_set->analyze_method, "sample") != 0)
+                && (strcmp(option_set->analyze_method, "histogram") != 0))
+            {
+                ereport(ERROR,
+                    (errcode(ERRCODE_SYNTAX_ERROR),
+                        errmsg("analyze_method should be set to \"sample\" or \"histogram\". Currently set to %s", option_set->analyze_method)
+                    ));
+            }
+        }
+        
         else if (strcmp(def->defname, "match_column_names") == 0)
         {      
             if (source == FOREIGN_TABLE)
@@ -868,6 +1184,23 @@ void tdsSetDefaultOptions(TdsFdwOptionSet *option_set)
             ));
     #endif
 
+    if ((option_set->analyze_method = palloc((strlen(DEFAULT_ANALYZE_METHOD) + 1) * sizeof(char))) == NULL)
+        {
+                ereport(ERROR,
+                        (errcode(ERRCODE_FDW_OUT_OF_MEMORY),
+                                errmsg("Failed to allocate memory for analyze method")
+                        ));
+        }
+
+    sprintf(option_set->analyze_method, "%s", DEFAULT_ANALYZE_METHOD);
+    tdsUpdateOptionSource("analyze_method", DEFAULT);
+
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("Set analyze_method to default: %s", option_set->analyze_method)
+            ));
+    #endif
+
     if ((option_set->msg_handler= palloc((strlen(DEFAULT_MSG_HANDLER) + 1) * sizeof(char))) == NULL)
         {
                 ereport(ERROR,
@@ -902,6 +1235,60 @@ void tdsSetDefaultOptions(TdsFdwOptionSet *option_set)
             ));
     #endif  
 
+    option_set->estimate_timeout = DEFAULT_ESTIMATE_TIMEOUT;
+    tdsUpdateOptionSource("estimate_timeout", DEFAULT);
+
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("Set estimate_timeout to default: %d", option_set->estimate_timeout)
+            ));
+    #endif  
+
+    option_set->fetch_size = DEFAULT_FETCH_SIZE;
+    tdsUpdateOptionSource("fetch_size", DEFAULT);
+
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("Set fetch_size to default: %d", option_set->fetch_size)
+            ));
+    #endif  
+
+    option_set->async_capable = DEFAULT_ASYNC_CAPABLE;
+    tdsUpdateOptionSource("async_capable", DEFAULT);
+
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("Set async_capable to default: %d", option_set->async_capable)
+            ));
+    #endif  
+
+    option_set->early_dispatch = DEFAULT_EARLY_DISPATCH;
+    tdsUpdateOptionSource("early_dispatch", DEFAULT);
+
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("Set early_dispatch to default: %d", option_set->early_dispatch)
+            ));
+    #endif  
+
+    option_set->max_lob_size = DEFAULT_MAX_LOB_SIZE;
+    tdsUpdateOptionSource("max_lob_size", DEFAULT);
+
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("Set max_lob_size to default: %d", option_set->max_lob_size)
+            ));
+    #endif  
+
+    option_set->truncate_lobs = DEFAULT_TRUNCATE_LOBS;
+    tdsUpdateOptionSource("truncate_lobs", DEFAULT);
+
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("Set truncate_lobs to default: %d", option_set->truncate_lobs)
+            ));
+    #endif  
+
     option_set->fdw_startup_cost = DEFAULT_FDW_STARTUP_COST;
     tdsUpdateOptionSource("fdw_startup_cost", DEFAULT);
 
@@ -964,6 +1351,15 @@ void tdsValidateForeignTableOptionSet(TdsFdwOptionSet *option_set)
                 errmsg("Conflicting options: table and query options can't be used together.")
             ));
     }
+
+    /* the ranges of partition_column are read from the table */
+    if (option_set->partition_column && option_set->query)
+    {
+        ereport(ERROR,
+            (errcode(ERRCODE_SYNTAX_ERROR),
+                errmsg("Conflicting options: partition_column and query options can't be used together.")
+            ));
+    }
     
     /* Check required options */
     
@@ -1061,6 +1457,7 @@ void tdsOptionSetInit(TdsFdwOptionSet* option_set)
     option_set->query = NULL;
     option_set->schema_name = NULL;
     option_set->table_name = NULL;
+    option_set->partition_column = NULL;
 
     #ifdef DEBUG
         ereport(NOTICE,
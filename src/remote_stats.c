@@ -0,0 +1,766 @@
+/*------------------------------------------------------------------
+*
+*               Foreign data wrapper for TDS (Sybase and Microsoft SQL Server)
+*
+* Author: Geoff Montee
+* Name: tds_fdw
+* File: tds_fdw/src/remote_stats.c
+*
+* Description:
+* This is a PostgreSQL foreign data wrapper for use to connect to databases that use TDS,
+* such as Sybase databases and Microsoft SQL server.
+*
+* This foreign data wrapper requires requires a library that uses the DB-Library interface,
+* such as FreeTDS (http://www.freetds.org/). This has been tested with FreeTDS, but not
+* the proprietary implementations of DB-Library.
+*----------------------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+/* postgres headers */
+
+#include "postgres.h"
+
+#if (PG_VERSION_NUM >= 120000)
+#include "access/htup_details.h"
+#include "access/table.h"
+#include "catalog/indexing.h"
+#include "catalog/pg_statistic.h"
+#include "catalog/pg_type.h"
+#include "commands/defrem.h"
+#include "commands/vacuum.h"
+#include "foreign/foreign.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/sortsupport.h"
+#include "utils/syscache.h"
+#include "utils/typcache.h"
+#endif
+
+/* DB-Library headers (e.g. FreeTDS */
+#include <sybfront.h>
+#include <sybdb.h>
+
+/* #define DEBUG */
+
+#include "tds_fdw.h"
+#include "remote_stats.h"
+
+#ifdef TDS_IMPORT_REMOTE_STATISTICS
+
+/* CONVERT(NVARCHAR(4000), ...) in UTF-8 */
+#define TDS_HISTOGRAM_KEY_LEN (4000 * 3 + 1)
+
+/* a step of a remote histogram, see sys.dm_db_stats_histogram */
+typedef struct TdsFdwHistogramStep
+{
+    char *high_key;             /* NULL for the step that counts NULLs */
+    double range_rows;          /* rows between the previous key and this one */
+    double equal_rows;          /* rows equal to high_key */
+    double distinct_range_rows; /* distinct values in range_rows */
+} TdsFdwHistogramStep;
+
+/* a local column with statistics on the remote server */
+typedef struct TdsFdwRemoteColumn
+{
+    AttrNumber attnum;
+    int stats_id;               /* remote statistics that lead with the column */
+    List *steps;                /* TdsFdwHistogramStep, in key order */
+} TdsFdwRemoteColumn;
+
+static void appendObjectId(StringInfo buf, const char *remote_relation);
+static bool isSupportedType(Oid typid);
+static AttrNumber findLocalColumn(Relation relation, const char *remote_name,
+    int remote_position, bool match_column_names);
+static List *getRemoteColumns(Relation relation, DBPROCESS *dbproc,
+    const char *remote_relation, bool match_column_names);
+static void getHistograms(DBPROCESS *dbproc, const char *remote_relation, List *columns);
+static bool storeColumnStatistics(Relation relation, TdsFdwRemoteColumn *column);
+static void updateStatistic(Oid relid, Form_pg_attribute attr,
+    float4 nullfrac, int32 width, float4 ndistinct,
+    int nmcv, Datum *mcv_values, float4 *mcv_freqs, Oid eqopr,
+    int nhist, Datum *hist_values, Oid ltopr);
+static int compareDatums(const void *a, const void *b, void *arg);
+
+/* append OBJECT_ID('remote_relation') to buf */
+
+static void appendObjectId(StringInfo buf, const char *remote_relation)
+{
+    const char *ptr;
+
+    appendStringInfoString(buf, "OBJECT_ID('");
+
+    for (ptr = remote_relation; *ptr; ptr++)
+    {
+        if (*ptr == '\'')
+            appendStringInfoChar(buf, '\'');
+        appendStringInfoChar(buf, *ptr);
+    }
+
+    appendStringInfoString(buf, "')");
+}
+
+/*
+ * the local types whose input functions accept the text that SQL Server
+ * writes for the histogram keys, and whose order is the same on both sides
+ */
+
+static bool isSupportedType(Oid typid)
+{
+    switch (typid)
+    {
+        case BOOLOID:
+        case INT2OID:
+        case INT4OID:
+        case INT8OID:
+        case FLOAT4OID:
+        case FLOAT8OID:
+        case NUMERICOID:
+        case TEXTOID:
+        case VARCHAROID:
+        case BPCHAROID:
+        case DATEOID:
+        case TIMEOID:
+        case TIMESTAMPOID:
+        case TIMESTAMPTZOID:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+ * find the local column of a remote column, by name or by position among the
+ * columns that are not dropped. Returns InvalidAttrNumber if there is none.
+ */
+
+static AttrNumber findLocalColumn(Relation relation, const char *remote_name,
+    int remote_position, bool match_column_names)
+{
+    TupleDesc tupdesc = RelationGetDescr(relation);
+    int position = 0;
+    int i;
+
+    for (i = 0; i < tupdesc->natts; i++)
+    {
+        Form_pg_attribute attr = TupleDescAttr(tupdesc, i);
+        char *local_name;
+        List *options;
+        ListCell *lc;
+
+        if (attr->attisdropped)
+            continue;
+
+        position++;
+
+        if (!match_column_names)
+        {
+            if (position == remote_position)
+                return attr->attnum;
+
+            continue;
+        }
+
+        local_name = NameStr(attr->attname);
+        options = GetForeignColumnOptions(RelationGetRelid(relation), attr->attnum);
+
+        foreach(lc, options)
+        {
+            DefElem *def = (DefElem *) lfirst(lc);
+
+            if (strcmp(def->defname, "column_name") == 0)
+                local_name = defGetString(def);
+        }
+
+        if (strncmp(local_name, remote_name, NAMEDATALEN) == 0)
+            return attr->attnum;
+    }
+
+    return InvalidAttrNumber;
+}
+
+/*
+ * get the local columns that have remote statistics, with the most recently
+ * updated statistics object that has the column as its first key
+ */
+
+static List *getRemoteColumns(Relation relation, DBPROCESS *dbproc,
+    const char *remote_relation, bool match_column_names)
+{
+    TupleDesc tupdesc = RelationGetDescr(relation);
+    StringInfoData query;
+    List *columns = NIL;
+    bool *found;
+    char name[512];
+    int position = 0;
+    int stats_id = 0;
+    RETCODE erc;
+    int ret_code;
+
+    initStringInfo(&query);
+    appendStringInfoString(&query,
+        "SELECT c.name, "
+        "CONVERT(INT, (SELECT COUNT(*) FROM sys.columns c2 "
+        "WHERE c2.object_id = c.object_id AND c2.column_id <= c.column_id)), "
+        "s.stats_id "
+        "FROM sys.stats s "
+        "JOIN sys.stats_columns sc ON sc.object_id = s.object_id "
+        "AND sc.stats_id = s.stats_id AND sc.stats_column_id = 1 "
+        "JOIN sys.columns c ON c.object_id = sc.object_id AND c.column_id = sc.column_id "
+        "CROSS APPLY sys.dm_db_stats_properties(s.object_id, s.stats_id) sp "
+        "WHERE s.object_id = ");
+    appendObjectId(&query, remote_relation);
+    appendStringInfoString(&query, " ORDER BY c.column_id, sp.last_updated DESC");
+
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Setting database command to %s", query.data)
+        ));
+
+    if (dbcmd(dbproc, query.data) == FAIL || dbsqlexec(dbproc) == FAIL)
+    {
+        ereport(ERROR,
+            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                errmsg("Failed to execute query %s", query.data)
+            ));
+    }
+
+    if ((erc = dbresults(dbproc)) == FAIL)
+    {
+        ereport(ERROR,
+            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                errmsg("Failed to get results from query %s", query.data)
+            ));
+    }
+
+    if (erc == NO_MORE_RESULTS)
+        return NIL;
+
+    if (dbbind(dbproc, 1, NTBSTRINGBIND, sizeof(name), (BYTE *) name) == FAIL
+        || dbbind(dbproc, 2, INTBIND, sizeof(int), (BYTE *) &position) == FAIL
+        || dbbind(dbproc, 3, INTBIND, sizeof(int), (BYTE *) &stats_id) == FAIL)
+    {
+        ereport(ERROR,
+            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                errmsg("Failed to bind results for query %s to a variable.", query.data)
+            ));
+    }
+
+    found = palloc0(tupdesc->natts * sizeof(bool));
+
+    while ((ret_code = dbnextrow(dbproc)) != NO_MORE_ROWS)
+    {
+        AttrNumber attnum;
+        TdsFdwRemoteColumn *column;
+
+        if (ret_code != REG_ROW)
+        {
+            ereport(ERROR,
+                (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                    errmsg("Failed to get row while getting statistics for table")
+                ));
+        }
+
+        attnum = findLocalColumn(relation, name, position, match_column_names);
+
+        /* the first row of a column has the most recent statistics */
+        if (attnum == InvalidAttrNumber || found[attnum - 1])
+            continue;
+
+        found[attnum - 1] = true;
+
+        if (!isSupportedType(TupleDescAttr(tupdesc, attnum - 1)->atttypid))
+        {
+            ereport(DEBUG3,
+                (errmsg("tds_fdw: Statistics of column %s can't be imported for its type", name)
+                ));
+            continue;
+        }
+
+        ereport(DEBUG3,
+            (errmsg("tds_fdw: Column %s has remote statistics %i", name, stats_id)
+            ));
+
+        column = (TdsFdwRemoteColumn *) palloc0(sizeof(TdsFdwRemoteColumn));
+        column->attnum = attnum;
+        column->stats_id = stats_id;
+        columns = lappend(columns, column);
+    }
+
+    while ((erc = dbresults(dbproc)) != NO_MORE_RESULTS)
+    {
+        if (erc == FAIL)
+        {
+            ereport(ERROR,
+                (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                    errmsg("Failed to get results from query %s", query.data)
+                ));
+        }
+    }
+
+    pfree(found);
+
+    return columns;
+}
+
+/*
+ * get the histogram steps of all of the columns, with one batch that has a
+ * query for each column
+ */
+
+static void getHistograms(DBPROCESS *dbproc, const char *remote_relation, List *columns)
+{
+    StringInfoData query;
+    ListCell *lc;
+    ListCell *column_lc;
+    char *key;
+    DBINT key_indicator = 0;
+    double range_rows = 0;
+    double equal_rows = 0;
+    double distinct_range_rows = 0;
+    RETCODE erc;
+    int ret_code;
+
+    initStringInfo(&query);
+
+    foreach(lc, columns)
+    {
+        TdsFdwRemoteColumn *column = (TdsFdwRemoteColumn *) lfirst(lc);
+
+        appendStringInfoString(&query,
+            "SELECT CONVERT(NVARCHAR(4000), h.range_high_key, 126), "
+            "CONVERT(FLOAT, h.range_rows), CONVERT(FLOAT, h.equal_rows), "
+            "CONVERT(FLOAT, h.distinct_range_rows) "
+            "FROM sys.dm_db_stats_histogram(");
+        appendObjectId(&query, remote_relation);
+        appendStringInfo(&query, ", %i) h ORDER BY h.step_number\n", column->stats_id);
+    }
+
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Setting database command to %s", query.data)
+        ));
+
+    if (dbcmd(dbproc, query.data) == FAIL || dbsqlexec(dbproc) == FAIL)
+    {
+        ereport(ERROR,
+            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                errmsg("Failed to execute query %s", query.data)
+            ));
+    }
+
+    key = palloc(TDS_HISTOGRAM_KEY_LEN);
+    column_lc = list_head(columns);
+
+    while ((erc = dbresults(dbproc)) != NO_MORE_RESULTS)
+    {
+        TdsFdwRemoteColumn *column;
+
+        if (erc == FAIL)
+        {
+            ereport(ERROR,
+                (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                    errmsg("Failed to get results from query %s", query.data)
+                ));
+        }
+
+        if (dbnumcols(dbproc) == 0)
+            continue;
+
+        if (column_lc == NULL)
+        {
+            ereport(ERROR,
+                (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                    errmsg("Got more histograms than the %i that were asked for", list_length(columns))
+                ));
+        }
+
+        column = (TdsFdwRemoteColumn *) lfirst(column_lc);
+#if (PG_VERSION_NUM >= 130000)
+        column_lc = lnext(columns, column_lc);
+#else
+        column_lc = lnext(column_lc);
+#endif
+
+        if (dbbind(dbproc, 1, NTBSTRINGBIND, TDS_HISTOGRAM_KEY_LEN, (BYTE *) key) == FAIL
+            || dbnullbind(dbproc, 1, &key_indicator) == FAIL
+            || dbbind(dbproc, 2, FLT8BIND, sizeof(double), (BYTE *) &range_rows) == FAIL
+            || dbbind(dbproc, 3, FLT8BIND, sizeof(double), (BYTE *) &equal_rows) == FAIL
+            || dbbind(dbproc, 4, FLT8BIND, sizeof(double), (BYTE *) &distinct_range_rows) == FAIL)
+        {
+            ereport(ERROR,
+                (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                    errmsg("Failed to bind results for query %s to a variable.", query.data)
+                ));
+        }
+
+        while ((ret_code = dbnextrow(dbproc)) != NO_MORE_ROWS)
+        {
+            TdsFdwHistogramStep *step;
+
+            if (ret_code != REG_ROW)
+            {
+                ereport(ERROR,
+                    (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                        errmsg("Failed to get row while getting histogram for table")
+                    ));
+            }
+
+            step = (TdsFdwHistogramStep *) palloc(sizeof(TdsFdwHistogramStep));
+            step->high_key = (key_indicator == -1) ? NULL : pstrdup(key);
+            step->range_rows = range_rows;
+            step->equal_rows = equal_rows;
+            step->distinct_range_rows = distinct_range_rows;
+            column->steps = lappend(column->steps, step);
+        }
+    }
+
+    pfree(key);
+}
+
+/*
+ * convert the histogram of a column to statistics in the form ANALYZE would
+ * compute them from a sample, and store them. Returns false if there was
+ * nothing to store.
+ */
+
+static bool storeColumnStatistics(Relation relation, TdsFdwRemoteColumn *column)
+{
+    Form_pg_attribute attr = TupleDescAttr(RelationGetDescr(relation), column->attnum - 1);
+    TypeCacheEntry *typentry;
+    Oid typinput;
+    Oid typioparam;
+    int nsteps;
+    int nkeys = 0;
+    Datum *keys;
+    bool *is_mcv;
+    double *equal_rows;
+    double *range_rows;
+    double nullrows = 0;
+    double nonnullrows = 0;
+    double totalrows;
+    double ndistinct = 0;
+    double distinct_range_rows = 0;
+    double mcv_threshold;
+    float4 stadistinct;
+    int nmcv = 0;
+    int *mcv_steps;
+    Datum *mcv_values;
+    float4 *mcv_freqs;
+    int nhist = 0;
+    Datum *hist_values = NULL;
+    ListCell *lc;
+    int i;
+
+    nsteps = list_length(column->steps);
+
+    if (nsteps == 0)
+        return false;
+
+    typentry = lookup_type_cache(attr->atttypid, TYPECACHE_EQ_OPR | TYPECACHE_LT_OPR);
+    getTypeInputInfo(attr->atttypid, &typinput, &typioparam);
+
+    keys = palloc(nsteps * sizeof(Datum));
+    is_mcv = palloc0(nsteps * sizeof(bool));
+    equal_rows = palloc(nsteps * sizeof(double));
+    range_rows = palloc(nsteps * sizeof(double));
+
+    foreach(lc, column->steps)
+    {
+        TdsFdwHistogramStep *step = (TdsFdwHistogramStep *) lfirst(lc);
+
+        if (step->high_key == NULL)
+        {
+            nullrows += step->equal_rows + step->range_rows;
+            continue;
+        }
+
+        keys[nkeys] = OidInputFunctionCall(typinput, step->high_key, typioparam, attr->atttypmod);
+        equal_rows[nkeys] = step->equal_rows;
+        range_rows[nkeys] = step->range_rows;
+        nkeys++;
+
+        nonnullrows += step->equal_rows + step->range_rows;
+        ndistinct += step->distinct_range_rows + (step->equal_rows > 0 ? 1 : 0);
+        distinct_range_rows += step->distinct_range_rows;
+    }
+
+    totalrows = nonnullrows + nullrows;
+
+    if (totalrows <= 0)
+        return false;
+
+    /* the same convention as ANALYZE: a negative value scales with the table */
+    if (ndistinct > 0.1 * totalrows)
+        stadistinct = (float4) -(ndistinct / totalrows);
+    else
+        stadistinct = (float4) ndistinct;
+
+    /*
+     * The keys are the most common values if they are all the values there
+     * are, otherwise those that are clearly more common than average, as
+     * ANALYZE would pick them.
+     */
+    mcv_steps = palloc(nkeys * sizeof(int));
+    mcv_values = palloc(nkeys * sizeof(Datum));
+    mcv_freqs = palloc(nkeys * sizeof(float4));
+
+    if (OidIsValid(typentry->eq_opr))
+    {
+        if (distinct_range_rows == 0 && nkeys <= default_statistics_target)
+            mcv_threshold = 0;
+        else
+            mcv_threshold = 1.25 * nonnullrows / Max(ndistinct, 1);
+
+        for (i = 0; i < nkeys; i++)
+        {
+            int j;
+
+            if (equal_rows[i] <= mcv_threshold || equal_rows[i] <= 0)
+                continue;
+
+            /* keep them sorted by frequency, most common first */
+            for (j = nmcv; j > 0 && equal_rows[mcv_steps[j - 1]] < equal_rows[i]; j--)
+                mcv_steps[j] = mcv_steps[j - 1];
+
+            mcv_steps[j] = i;
+            nmcv++;
+        }
+
+        nmcv = Min(nmcv, default_statistics_target);
+
+        for (i = 0; i < nmcv; i++)
+        {
+            mcv_values[i] = keys[mcv_steps[i]];
+            mcv_freqs[i] = (float4) (equal_rows[mcv_steps[i]] / totalrows);
+            is_mcv[mcv_steps[i]] = true;
+        }
+    }
+
+    /*
+     * The histogram covers the rows that are not most common values, with
+     * about the same number of rows between its bounds. The keys are the only
+     * values we know, so each bound is the first key at or after the row it
+     * should be at.
+     */
+    if (OidIsValid(typentry->lt_opr) && nkeys - nmcv >= 2)
+    {
+        double histrows = 0;
+        double cumrows = 0;
+        int nbins;
+        int bin = 0;
+        SortSupportData ssup;
+
+        for (i = 0; i < nkeys; i++)
+            histrows += range_rows[i] + (is_mcv[i] ? 0 : equal_rows[i]);
+
+        nbins = Min(default_statistics_target, nkeys - 1);
+        hist_values = palloc((nbins + 2) * sizeof(Datum));
+
+        for (i = 0; i < nkeys && histrows > 0; i++)
+        {
+            cumrows += range_rows[i] + (is_mcv[i] ? 0 : equal_rows[i]);
+
+            while (bin <= nbins && cumrows >= bin * histrows / nbins)
+            {
+                hist_values[nhist++] = keys[i];
+                bin++;
+            }
+        }
+
+        /* the last bound is the largest value */
+        if (nhist > 0 && hist_values[nhist - 1] != keys[nkeys - 1])
+            hist_values[nhist++] = keys[nkeys - 1];
+
+        /* the remote collation may sort differently, so sort locally */
+        memset(&ssup, 0, sizeof(ssup));
+        ssup.ssup_cxt = CurrentMemoryContext;
+        ssup.ssup_collation = attr->attcollation;
+        ssup.ssup_nulls_first = false;
+        PrepareSortSupportFromOrderingOp(typentry->lt_opr, &ssup);
+
+        qsort_arg(hist_values, nhist, sizeof(Datum), compareDatums, &ssup);
+
+        /* bounds that are the same key only count once */
+        if (nhist > 0)
+        {
+            int ndistinct_bounds = 1;
+
+            for (i = 1; i < nhist; i++)
+            {
+                if (ApplySortComparator(hist_values[i], false,
+                                        hist_values[ndistinct_bounds - 1], false, &ssup) != 0)
+                    hist_values[ndistinct_bounds++] = hist_values[i];
+            }
+
+            nhist = ndistinct_bounds;
+        }
+
+        if (nhist < 2)
+            nhist = 0;
+    }
+
+    updateStatistic(RelationGetRelid(relation), attr,
+                    (float4) (nullrows / totalrows),
+                    get_typavgwidth(attr->atttypid, attr->atttypmod),
+                    stadistinct,
+                    nmcv, mcv_values, mcv_freqs, typentry->eq_opr,
+                    nhist, hist_values, typentry->lt_opr);
+
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Column %s: null_frac = %g, n_distinct = %g, %i most common values, %i histogram bounds",
+            NameStr(attr->attname), nullrows / totalrows, stadistinct, nmcv, nhist)
+        ));
+
+    return true;
+}
+
+static int compareDatums(const void *a, const void *b, void *arg)
+{
+    return ApplySortComparator(*(const Datum *) a, false,
+                               *(const Datum *) b, false,
+                               (SortSupport) arg);
+}
+
+/*
+ * insert or replace the pg_statistic row of a column, the way ANALYZE does
+ * in update_attstats()
+ */
+
+static void updateStatistic(Oid relid, Form_pg_attribute attr,
+    float4 nullfrac, int32 width, float4 ndistinct,
+    int nmcv, Datum *mcv_values, float4 *mcv_freqs, Oid eqopr,
+    int nhist, Datum *hist_values, Oid ltopr)
+{
+    Relation sd;
+    HeapTuple stup;
+    HeapTuple oldtup;
+    Datum values[Natts_pg_statistic];
+    bool nulls[Natts_pg_statistic];
+    bool replaces[Natts_pg_statistic];
+    int16 typlen;
+    bool typbyval;
+    char typalign;
+    int i;
+    int k;
+
+    get_typlenbyvalalign(attr->atttypid, &typlen, &typbyval, &typalign);
+
+    for (i = 0; i < Natts_pg_statistic; i++)
+    {
+        nulls[i] = false;
+        replaces[i] = true;
+    }
+
+    values[Anum_pg_statistic_starelid - 1] = ObjectIdGetDatum(relid);
+    values[Anum_pg_statistic_staattnum - 1] = Int16GetDatum(attr->attnum);
+    values[Anum_pg_statistic_stainherit - 1] = BoolGetDatum(false);
+    values[Anum_pg_statistic_stanullfrac - 1] = Float4GetDatum(nullfrac);
+    values[Anum_pg_statistic_stawidth - 1] = Int32GetDatum(width);
+    values[Anum_pg_statistic_stadistinct - 1] = Float4GetDatum(ndistinct);
+
+    for (k = 0; k < STATISTIC_NUM_SLOTS; k++)
+    {
+        values[Anum_pg_statistic_stakind1 - 1 + k] = Int16GetDatum(0);
+        values[Anum_pg_statistic_staop1 - 1 + k] = ObjectIdGetDatum(InvalidOid);
+        values[Anum_pg_statistic_stacoll1 - 1 + k] = ObjectIdGetDatum(InvalidOid);
+        nulls[Anum_pg_statistic_stanumbers1 - 1 + k] = true;
+        nulls[Anum_pg_statistic_stavalues1 - 1 + k] = true;
+    }
+
+    k = 0;
+
+    if (nmcv > 0)
+    {
+        Datum *numdatums = palloc(nmcv * sizeof(Datum));
+
+        for (i = 0; i < nmcv; i++)
+            numdatums[i] = Float4GetDatum(mcv_freqs[i]);
+
+        values[Anum_pg_statistic_stakind1 - 1 + k] = Int16GetDatum(STATISTIC_KIND_MCV);
+        values[Anum_pg_statistic_staop1 - 1 + k] = ObjectIdGetDatum(eqopr);
+        values[Anum_pg_statistic_stacoll1 - 1 + k] = ObjectIdGetDatum(attr->attcollation);
+        values[Anum_pg_statistic_stanumbers1 - 1 + k] =
+            PointerGetDatum(construct_array(numdatums, nmcv, FLOAT4OID,
+                                            sizeof(float4), FLOAT4PASSBYVAL, 'i'));
+        nulls[Anum_pg_statistic_stanumbers1 - 1 + k] = false;
+        values[Anum_pg_statistic_stavalues1 - 1 + k] =
+            PointerGetDatum(construct_array(mcv_values, nmcv, attr->atttypid,
+                                            typlen, typbyval, typalign));
+        nulls[Anum_pg_statistic_stavalues1 - 1 + k] = false;
+        k++;
+    }
+
+    if (nhist > 0)
+    {
+        values[Anum_pg_statistic_stakind1 - 1 + k] = Int16GetDatum(STATISTIC_KIND_HISTOGRAM);
+        values[Anum_pg_statistic_staop1 - 1 + k] = ObjectIdGetDatum(ltopr);
+        values[Anum_pg_statistic_stacoll1 - 1 + k] = ObjectIdGetDatum(attr->attcollation);
+        values[Anum_pg_statistic_stavalues1 - 1 + k] =
+            PointerGetDatum(construct_array(hist_values, nhist, attr->atttypid,
+                                            typlen, typbyval, typalign));
+        nulls[Anum_pg_statistic_stavalues1 - 1 + k] = false;
+        k++;
+    }
+
+    sd = table_open(StatisticRelationId, RowExclusiveLock);
+
+    oldtup = SearchSysCache3(STATRELATTINH,
+                             ObjectIdGetDatum(relid),
+                             Int16GetDatum(attr->attnum),
+                             BoolGetDatum(false));
+
+    if (HeapTupleIsValid(oldtup))
+    {
+        stup = heap_modify_tuple(oldtup, RelationGetDescr(sd), values, nulls, replaces);
+        ReleaseSysCache(oldtup);
+        CatalogTupleUpdate(sd, &stup->t_self, stup);
+    }
+    else
+    {
+        stup = heap_form_tuple(RelationGetDescr(sd), values, nulls);
+        CatalogTupleInsert(sd, stup);
+    }
+
+    heap_freetuple(stup);
+    table_close(sd, RowExclusiveLock);
+}
+
+int tdsImportRemoteStatistics(Relation relation, DBPROCESS *dbproc,
+    const char *remote_relation, bool match_column_names)
+{
+    List *columns;
+    ListCell *lc;
+    int nimported = 0;
+
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> starting tdsImportRemoteStatistics")
+            ));
+    #endif
+
+    columns = getRemoteColumns(relation, dbproc, remote_relation, match_column_names);
+
+    if (columns != NIL)
+        getHistograms(dbproc, remote_relation, columns);
+
+    foreach(lc, columns)
+    {
+        TdsFdwRemoteColumn *column = (TdsFdwRemoteColumn *) lfirst(lc);
+
+        if (storeColumnStatistics(relation, column))
+            nimported++;
+    }
+
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> finishing tdsImportRemoteStatistics")
+            ));
+    #endif
+
+    return nimported;
+}
+
+#endif  /* TDS_IMPORT_REMOTE_STATISTICS */
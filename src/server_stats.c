@@ -0,0 +1,476 @@
+/*------------------------------------------------------------------
+*
+*               Foreign data wrapper for TDS (Sybase and Microsoft SQL Server)
+*
+* Author: Geoff Montee
+* Name: tds_fdw
+* File: tds_fdw/src/server_stats.c
+*
+* Description:
+* This is a PostgreSQL foreign data wrapper for use to connect to databases that use TDS,
+* such as Sybase databases and Microsoft SQL server.
+*
+* This foreign data wrapper requires requires a library that uses the DB-Library interface,
+* such as FreeTDS (http://www.freetds.org/). This has been tested with FreeTDS, but not
+* the proprietary implementations of DB-Library.
+*----------------------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+/* Override PGDLLEXPORT for visibility */
+
+#include "visibility.h"
+
+/* postgres headers */
+
+#include "postgres.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "nodes/execnodes.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
+
+/* #define DEBUG */
+
+#include "server_stats.h"
+
+/* GUCs */
+
+static const int DEFAULT_LATENCY_SAMPLE_INTERVAL = 60;
+static int latency_sample_interval = 60;
+
+/* weight of a new measurement in the moving averages */
+#define TDS_LATENCY_EWMA_WEIGHT 0.2
+
+typedef struct TdsFdwServerStatsKey
+{
+    Oid dbid;
+    Oid serverid;
+} TdsFdwServerStatsKey;
+
+typedef struct TdsFdwServerStatsEntry
+{
+    TdsFdwServerStatsKey key;   /* hash key (must be first) */
+    double connect_ms;          /* moving average of the login time */
+    double rtt_ms;              /* moving average of the round trip time */
+    int64 connects;             /* number of logins measured */
+    int64 round_trips;          /* number of round trips measured */
+    TimestampTz rtt_sampled_at; /* when the last round trip was measured */
+    double scan_startup_ms;     /* moving average of the time to first result */
+    double scan_ms_per_byte;    /* moving average of the time to fetch a byte */
+    int64 scans;                /* number of finished scans */
+    int64 scans_with_rows;      /* number of those that fetched any bytes */
+    double rows_fetched;        /* rows fetched by all scans */
+    double bytes_fetched;       /* bytes fetched by all scans */
+} TdsFdwServerStatsEntry;
+
+/* the statistics are shared if this backend attached to shared memory */
+static HTAB *server_stats_hash = NULL;
+static LWLock *server_stats_lock = NULL;
+
+#ifdef TDS_SHARED_SERVER_STATS
+#if (PG_VERSION_NUM >= 150000)
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+static void tdsServerStatsShmemRequest(void);
+static void tdsServerStatsShmemStartup(void);
+#endif
+
+static HTAB *tdsServerStatsHash(void);
+static void tdsServerStatsLock(LWLockMode mode);
+static void tdsServerStatsUnlock(void);
+static TdsFdwServerStatsEntry *tdsServerStatsEntry(Oid serverid, bool create);
+
+PG_FUNCTION_INFO_V1(tds_fdw_server_stats);
+
+void tdsServerStatsInit(void)
+{
+    DefineCustomIntVariable("tds_fdw.latency_sample_interval",
+        "Interval between round trip measurements of a foreign server",
+        "The round trip time to a foreign server is measured again when a connection is opened or borrowed this many seconds after the last measurement. Set to 0 to only measure it once",
+        &latency_sample_interval,
+        DEFAULT_LATENCY_SAMPLE_INTERVAL,
+        0,
+        INT_MAX,
+        PGC_USERSET,
+        GUC_UNIT_S,
+        NULL,
+        NULL,
+        NULL);
+
+#ifdef TDS_SHARED_SERVER_STATS
+    if (!process_shared_preload_libraries_in_progress)
+        return;
+
+#if (PG_VERSION_NUM >= 150000)
+    prev_shmem_request_hook = shmem_request_hook;
+    shmem_request_hook = tdsServerStatsShmemRequest;
+#else
+    tdsServerStatsShmemRequest();
+#endif
+    prev_shmem_startup_hook = shmem_startup_hook;
+    shmem_startup_hook = tdsServerStatsShmemStartup;
+#endif
+}
+
+#ifdef TDS_SHARED_SERVER_STATS
+
+static void tdsServerStatsShmemRequest(void)
+{
+#if (PG_VERSION_NUM >= 150000)
+    if (prev_shmem_request_hook)
+        prev_shmem_request_hook();
+#endif
+
+    RequestAddinShmemSpace(hash_estimate_size(TDS_SERVER_STATS_MAX_ENTRIES,
+                                              sizeof(TdsFdwServerStatsEntry)));
+    RequestNamedLWLockTranche("tds_fdw server stats", 1);
+}
+
+static void tdsServerStatsShmemStartup(void)
+{
+    HASHCTL ctl;
+
+    if (prev_shmem_startup_hook)
+        prev_shmem_startup_hook();
+
+    MemSet(&ctl, 0, sizeof(ctl));
+    ctl.keysize = sizeof(TdsFdwServerStatsKey);
+    ctl.entrysize = sizeof(TdsFdwServerStatsEntry);
+
+    LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+    server_stats_lock = &(GetNamedLWLockTranche("tds_fdw server stats"))->lock;
+    server_stats_hash = ShmemInitHash("tds_fdw server stats",
+                                      TDS_SERVER_STATS_MAX_ENTRIES,
+                                      TDS_SERVER_STATS_MAX_ENTRIES,
+                                      &ctl,
+                                      HASH_ELEM | HASH_BLOBS);
+
+    LWLockRelease(AddinShmemInitLock);
+}
+
+#endif  /* TDS_SHARED_SERVER_STATS */
+
+/* without shared memory, keep statistics local to this backend */
+
+static HTAB *tdsServerStatsHash(void)
+{
+    if (server_stats_hash == NULL)
+    {
+        HASHCTL ctl;
+
+        MemSet(&ctl, 0, sizeof(ctl));
+        ctl.keysize = sizeof(TdsFdwServerStatsKey);
+        ctl.entrysize = sizeof(TdsFdwServerStatsEntry);
+        ctl.hcxt = TopMemoryContext;
+#if (PG_VERSION_NUM >= 90500)
+        server_stats_hash = hash_create("tds_fdw server stats", 8, &ctl,
+                                        HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+#else
+        ctl.hash = tag_hash;
+        server_stats_hash = hash_create("tds_fdw server stats", 8, &ctl,
+                                        HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+#endif
+    }
+
+    return server_stats_hash;
+}
+
+static void tdsServerStatsLock(LWLockMode mode)
+{
+    if (server_stats_lock != NULL)
+        LWLockAcquire(server_stats_lock, mode);
+}
+
+static void tdsServerStatsUnlock(void)
+{
+    if (server_stats_lock != NULL)
+        LWLockRelease(server_stats_lock);
+}
+
+/*
+ * Find the entry of a foreign server, and optionally create it. Returns NULL
+ * if there is none, or if the shared table is full. Must be called with the
+ * lock held, exclusively if create is set.
+ */
+static TdsFdwServerStatsEntry *tdsServerStatsEntry(Oid serverid, bool create)
+{
+    TdsFdwServerStatsKey key;
+    TdsFdwServerStatsEntry *entry;
+    HASHACTION action;
+    bool found;
+
+    MemSet(&key, 0, sizeof(key));
+    key.dbid = MyDatabaseId;
+    key.serverid = serverid;
+
+    /* HASH_ENTER_NULL is only allowed for the shared table */
+    if (!create)
+        action = HASH_FIND;
+    else if (server_stats_lock != NULL)
+        action = HASH_ENTER_NULL;
+    else
+        action = HASH_ENTER;
+
+    entry = (TdsFdwServerStatsEntry *) hash_search(tdsServerStatsHash(), &key,
+        action, &found);
+
+    if (entry != NULL && !found)
+    {
+        entry->connect_ms = 0;
+        entry->rtt_ms = 0;
+        entry->connects = 0;
+        entry->round_trips = 0;
+        entry->rtt_sampled_at = 0;
+        entry->scan_startup_ms = 0;
+        entry->scan_ms_per_byte = 0;
+        entry->scans = 0;
+        entry->scans_with_rows = 0;
+        entry->rows_fetched = 0;
+        entry->bytes_fetched = 0;
+    }
+
+    return entry;
+}
+
+void tdsServerStatsAddConnect(Oid serverid, double connect_ms)
+{
+    TdsFdwServerStatsEntry *entry;
+
+    tdsServerStatsLock(LW_EXCLUSIVE);
+
+    entry = tdsServerStatsEntry(serverid, true);
+
+    if (entry != NULL)
+    {
+        if (entry->connects == 0)
+            entry->connect_ms = connect_ms;
+        else
+            entry->connect_ms += TDS_LATENCY_EWMA_WEIGHT * (connect_ms - entry->connect_ms);
+
+        entry->connects++;
+    }
+
+    tdsServerStatsUnlock();
+
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Login took %.3f ms", connect_ms)
+        ));
+}
+
+void tdsServerStatsAddRoundTrip(Oid serverid, double rtt_ms)
+{
+    TdsFdwServerStatsEntry *entry;
+
+    tdsServerStatsLock(LW_EXCLUSIVE);
+
+    entry = tdsServerStatsEntry(serverid, true);
+
+    if (entry != NULL)
+    {
+        if (entry->round_trips == 0)
+            entry->rtt_ms = rtt_ms;
+        else
+            entry->rtt_ms += TDS_LATENCY_EWMA_WEIGHT * (rtt_ms - entry->rtt_ms);
+
+        entry->round_trips++;
+        entry->rtt_sampled_at = GetCurrentTimestamp();
+    }
+
+    tdsServerStatsUnlock();
+
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Round trip took %.3f ms", rtt_ms)
+        ));
+}
+
+bool tdsServerStatsRoundTripDue(Oid serverid)
+{
+    TdsFdwServerStatsEntry *entry;
+    bool due = true;
+
+    tdsServerStatsLock(LW_SHARED);
+
+    entry = tdsServerStatsEntry(serverid, false);
+
+    if (entry != NULL && entry->round_trips > 0)
+        due = latency_sample_interval > 0 &&
+            TimestampDifferenceExceeds(entry->rtt_sampled_at, GetCurrentTimestamp(),
+                                       latency_sample_interval * 1000);
+
+    tdsServerStatsUnlock();
+
+    return due;
+}
+
+bool tdsServerStatsGetLatency(Oid serverid, double *connect_ms, double *rtt_ms)
+{
+    TdsFdwServerStatsEntry *entry;
+    bool found = false;
+
+    tdsServerStatsLock(LW_SHARED);
+
+    entry = tdsServerStatsEntry(serverid, false);
+
+    if (entry != NULL && entry->round_trips > 0)
+    {
+        *connect_ms = entry->connects > 0 ? entry->connect_ms : -1;
+        *rtt_ms = entry->rtt_ms;
+        found = true;
+    }
+
+    tdsServerStatsUnlock();
+
+    return found;
+}
+
+void tdsServerStatsAddScan(Oid serverid, double startup_ms, double fetch_ms,
+    double rows, double bytes)
+{
+    TdsFdwServerStatsEntry *entry;
+
+    tdsServerStatsLock(LW_EXCLUSIVE);
+
+    entry = tdsServerStatsEntry(serverid, true);
+
+    if (entry != NULL)
+    {
+        if (entry->scans == 0)
+            entry->scan_startup_ms = startup_ms;
+        else
+            entry->scan_startup_ms += TDS_LATENCY_EWMA_WEIGHT * (startup_ms - entry->scan_startup_ms);
+
+        entry->scans++;
+
+        if (bytes > 0)
+        {
+            double ms_per_byte = fetch_ms / bytes;
+
+            if (entry->scans_with_rows == 0)
+                entry->scan_ms_per_byte = ms_per_byte;
+            else
+                entry->scan_ms_per_byte += TDS_LATENCY_EWMA_WEIGHT * (ms_per_byte - entry->scan_ms_per_byte);
+
+            entry->scans_with_rows++;
+        }
+
+        entry->rows_fetched += rows;
+        entry->bytes_fetched += bytes;
+    }
+
+    tdsServerStatsUnlock();
+
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Scan took %.3f ms to start, and %.3f ms to fetch %.0f rows (%.0f bytes)",
+            startup_ms, fetch_ms, rows, bytes)
+        ));
+}
+
+bool tdsServerStatsGetScanTimes(Oid serverid, double *startup_ms, double *ms_per_byte)
+{
+    TdsFdwServerStatsEntry *entry;
+    bool found = false;
+
+    tdsServerStatsLock(LW_SHARED);
+
+    entry = tdsServerStatsEntry(serverid, false);
+
+    if (entry != NULL && entry->scans > 0)
+    {
+        *startup_ms = entry->scan_startup_ms;
+        *ms_per_byte = entry->scans_with_rows > 0 ? entry->scan_ms_per_byte : -1;
+        found = true;
+    }
+
+    tdsServerStatsUnlock();
+
+    return found;
+}
+
+/* list the statistics of all foreign servers */
+
+PGDLLEXPORT Datum tds_fdw_server_stats(PG_FUNCTION_ARGS)
+{
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+    TupleDesc tupdesc;
+    Tuplestorestate *tupstore;
+    MemoryContext per_query_ctx;
+    MemoryContext old_cxt;
+    HASH_SEQ_STATUS scan;
+    TdsFdwServerStatsEntry *entry;
+
+    if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+        ereport(ERROR,
+            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                errmsg("set-valued function called in context that cannot accept a set")
+            ));
+
+    if (!(rsinfo->allowedModes & SFRM_Materialize))
+        ereport(ERROR,
+            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                errmsg("materialize mode required, but it is not allowed in this context")
+            ));
+
+    per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+    old_cxt = MemoryContextSwitchTo(per_query_ctx);
+
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+        elog(ERROR, "return type must be a row type");
+
+    tupstore = tuplestore_begin_heap(true, false, work_mem);
+    rsinfo->returnMode = SFRM_Materialize;
+    rsinfo->setResult = tupstore;
+    rsinfo->setDesc = tupdesc;
+
+    MemoryContextSwitchTo(old_cxt);
+
+    tdsServerStatsLock(LW_SHARED);
+
+    hash_seq_init(&scan, tdsServerStatsHash());
+    while ((entry = (TdsFdwServerStatsEntry *) hash_seq_search(&scan)))
+    {
+        Datum values[13];
+        bool nulls[13];
+
+        MemSet(nulls, 0, sizeof(nulls));
+
+        values[0] = ObjectIdGetDatum(entry->key.dbid);
+        values[1] = ObjectIdGetDatum(entry->key.serverid);
+        values[2] = Float8GetDatum(entry->connect_ms);
+        values[3] = Int64GetDatum(entry->connects);
+        values[4] = Float8GetDatum(entry->rtt_ms);
+        values[5] = Int64GetDatum(entry->round_trips);
+        values[6] = TimestampTzGetDatum(entry->rtt_sampled_at);
+        values[7] = Int64GetDatum(entry->scans);
+        values[8] = Float8GetDatum(entry->scan_startup_ms);
+        values[9] = Float8GetDatum(entry->scan_ms_per_byte);
+        values[10] = Float8GetDatum(entry->rows_fetched);
+        values[11] = Float8GetDatum(entry->bytes_fetched);
+        values[12] = Float8GetDatum(entry->rows_fetched > 0 ?
+                                    entry->bytes_fetched / entry->rows_fetched : 0);
+
+        nulls[2] = entry->connects == 0;
+        nulls[4] = nulls[6] = entry->round_trips == 0;
+        nulls[8] = entry->scans == 0;
+        nulls[9] = entry->scans_with_rows == 0;
+        nulls[12] = entry->rows_fetched == 0;
+
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+
+    tdsServerStatsUnlock();
+
+    return (Datum) 0;
+}
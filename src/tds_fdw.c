@@ -18,6 +18,7 @@
 
 
 
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -31,7 +32,9 @@
 
 #include "postgres.h"
 #include "funcapi.h"
+#include "access/heapam.h"
 #include "access/reloptions.h"
+#include "access/xact.h"
 #include "catalog/pg_foreign_server.h"
 #include "catalog/pg_foreign_table.h"
 #include "catalog/pg_user_mapping.h"
@@ -50,6 +53,7 @@
 #include "libpq/pqsignal.h"
 #include "optimizer/cost.h"
 #include "optimizer/paths.h"
+#include "optimizer/plancat.h"
 #include "optimizer/prep.h"
 #if (PG_VERSION_NUM < 120000)
 #include "optimizer/var.h"
@@ -59,9 +63,14 @@
 #include "storage/fd.h"
 #include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/date.h"
+#include "utils/datetime.h"
 #include "utils/rel.h"
 #include "utils/memutils.h"
 #include "utils/guc.h"
+#include "utils/numeric.h"
+#include "utils/pg_locale.h"
+#include "utils/resowner.h"
 #include "utils/timestamp.h"
 
 #if (PG_VERSION_NUM >= 90300)
@@ -74,6 +83,11 @@
 #include "optimizer/restrictinfo.h"
 #include "optimizer/planmain.h"
 
+#if (PG_VERSION_NUM >= 140000)
+#include "executor/execAsync.h"
+#include "storage/latch.h"
+#endif
+
 /* DB-Library headers (e.g. FreeTDS */
 #include <sybfront.h>
 #include <sybdb.h>
@@ -85,6 +99,10 @@ PG_MODULE_MAGIC;
 #include "tds_fdw.h"
 #include "options.h"
 #include "deparse.h"
+#include "connection.h"
+#include "estimate_cache.h"
+#include "remote_stats.h"
+#include "server_stats.h"
 
 /* run on module load */
 
@@ -101,10 +119,31 @@ static bool show_after_row_memory_stats = false;
 
 static const double DEFAULT_FDW_SORT_MULTIPLIER=1.2;
 
+/* planner cost of a millisecond spent waiting on the network */
+#define TDS_COST_PER_MS 100.0
+
+/* bytes a server can stream within one round trip, about a TCP window */
+#define TDS_BYTES_PER_ROUND_TRIP 65536.0
+
+/* costs used for 'auto' until the server has been scanned */
+#define TDS_AUTO_STARTUP_COST_DEFAULT 100
+#define TDS_AUTO_TUPLE_COST_DEFAULT 100
+
+/* ranges of partition_column per process of a parallel scan */
+#define TDS_RANGES_PER_PROCESS 4
+
 /* error handling */
 
 static char* last_error_message = NULL;
 
+/* is a remote estimate running with a time limit, and did it run out? */
+static bool estimate_timeout_active = false;
+static bool estimate_timed_out = false;
+
+/* when the remote estimate started, and how many seconds it may take */
+static instr_time estimate_start;
+static int estimate_timeout;
+
 static int tds_err_capture(DBPROCESS *dbproc, int severity, int dberr, int oserr, char *dberrstr, char *oserrstr);
 static char *tds_err_msg(int severity, int dberr, int oserr, char *dberrstr, char *oserrstr);
 
@@ -131,6 +170,82 @@ static bool tdsIsSqlServer(DBPROCESS *dbproc);
  */
 static void tdsSetSqlServerAnsiMode(DBPROCESS **dbproc);
 
+/* runs a query that returns a single number */
+static double tdsQueryDouble(char *query, DBPROCESS *dbproc, double default_value);
+
+/* run a query that returns a single value, bound to the given variable */
+static void tdsQueryValue(char *query, DBPROCESS *dbproc, int vartype, DBINT varlen, BYTE *varaddr);
+
+/* has a remote estimate with estimate_timeout run out of time? */
+static bool tdsEstimateTimeIsUp(void);
+
+/* appends the remote name of the foreign table */
+static void tdsAppendRemoteRelation(StringInfo buf, TdsFdwOptionSet* option_set);
+
+/* turns SHOWPLAN_ALL on or off for a connection */
+static void tdsSetShowPlanAll(DBPROCESS *dbproc, bool on);
+
+/* pathkeys that can be sent to the remote server, or NIL */
+static List *tdsGetUsablePathkeys(PlannerInfo *root, RelOptInfo *baserel, List *pathkeys);
+
+/* remote estimates of the queries the planner will ask about for a relation */
+static double tdsGetCandidateRowCounts(PlannerInfo *root, RelOptInfo *baserel,
+    TdsFdwOptionSet *option_set, List *remote_join_conds, DBPROCESS *dbproc);
+
+/* fdw_startup_cost, fdw_tuple_cost and network costs of a relation */
+static void tdsSetScanCosts(TdsFdwRelationInfo *fpinfo, TdsFdwOptionSet *option_set, int width);
+
+/* remote estimate of option_set->query, within estimate_timeout */
+static double tdsGetRemoteEstimate(PlannerInfo *root, RelOptInfo *baserel,
+    TdsFdwOptionSet *option_set, List *remote_join_conds);
+
+/* remember a remote estimate for the rest of the planning of a relation */
+static void tdsRememberRemoteEstimate(TdsFdwRelationInfo *fpinfo, const char *query, double rows);
+
+/* bind the fetched columns and pick the decoder of each one */
+static void tdsBindColumns(TdsFdwExecutionState *festate);
+
+/* make the next row of a scan the current one, like dbnextrow() */
+static int tdsNextRow(TdsFdwExecutionState *festate);
+
+/* send the query of a scan, and wait for its results */
+static void tdsSendQuery(TdsFdwExecutionState *festate);
+static void tdsOpenResults(ForeignScanState *node);
+
+/* can the next row of a scan be had without waiting for the network? */
+static bool tdsRowReady(TdsFdwExecutionState *festate);
+
+/* take the next range of partition_column in a parallel scan */
+static bool tdsNextRange(TdsFdwExecutionState *festate);
+
+#ifdef PARALLEL_API
+/* can scans of the table be split by partition_column? */
+static bool tdsCanSplitByRanges(Oid foreigntableid, TdsFdwOptionSet *option_set);
+#endif
+
+/* column decoders, see tdsBindColumns() */
+static Datum tdsDecodeBool(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen);
+static Datum tdsDecodeInt2(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen);
+static Datum tdsDecodeInt4(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen);
+static Datum tdsDecodeInt8(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen);
+static Datum tdsDecodeFloat4(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen);
+static Datum tdsDecodeFloat8(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen);
+static Datum tdsDecodeText(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen);
+static Datum tdsDecodeChar(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen);
+static Datum tdsDecodeBytea(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen);
+static Datum tdsDecodeUuid(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen);
+#if (PG_VERSION_NUM >= 100000)
+static Datum tdsDecodeTemporal(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen);
+#elif (PG_VERSION_NUM >= 90400)
+static Datum tdsDecodeDatetime(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen);
+#endif
+#if (PG_VERSION_NUM >= 140000)
+static Datum tdsDecodeNumeric(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen);
+#endif
+static Datum tdsDecodeCash(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen);
+static Datum tdsDecodeInput(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen);
+static Datum tdsDecodeLob(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen);
+
 /*
  * Indexes of FDW-private information stored in fdw_private lists.
  *
@@ -139,6 +254,8 @@ static void tdsSetSqlServerAnsiMode(DBPROCESS **dbproc);
  *
  * 1) SELECT statement text to be sent to the remote server
  * 2) Integer list of attribute numbers retrieved by the SELECT
+ * 3) Quoted partition_column, for a parallel aware scan
+ * 4) Boolean flag showing if the SELECT has a WHERE clause
  *
  * These items are indexed with the enum FdwScanPrivateIndex, so an item
  * can be fetched with list_nth().  For example, to get the SELECT statement:
@@ -149,7 +266,11 @@ enum FdwScanPrivateIndex
     /* SQL statement to execute remotely (as a String node) */
     FdwScanPrivateSelectSql,
     /* Integer list of attribute numbers retrieved by the SELECT */
-    FdwScanPrivateRetrievedAttrs
+    FdwScanPrivateRetrievedAttrs,
+    /* partition_column, quoted, or an empty string (as a String node) */
+    FdwScanPrivateRangeColumn,
+    /* has-WHERE flag (as an Integer node) */
+    FdwScanPrivateRangeHasWhere
 };
 
 PG_FUNCTION_INFO_V1(tds_fdw_handler);
@@ -184,6 +305,23 @@ PGDLLEXPORT Datum tds_fdw_handler(PG_FUNCTION_ARGS)
     fdwroutine->ImportForeignSchema = tdsImportForeignSchema;
 #endif  /* IMPORT_API */
 
+#ifdef PARALLEL_API
+    fdwroutine->IsForeignScanParallelSafe = tdsIsForeignScanParallelSafe;
+    fdwroutine->EstimateDSMForeignScan = tdsEstimateDSMForeignScan;
+    fdwroutine->InitializeDSMForeignScan = tdsInitializeDSMForeignScan;
+#if (PG_VERSION_NUM >= 100000)
+    fdwroutine->ReInitializeDSMForeignScan = tdsReInitializeDSMForeignScan;
+#endif
+    fdwroutine->InitializeWorkerForeignScan = tdsInitializeWorkerForeignScan;
+#endif  /* PARALLEL_API */
+
+#ifdef ASYNC_API
+    fdwroutine->IsForeignPathAsyncCapable = tdsIsForeignPathAsyncCapable;
+    fdwroutine->ForeignAsyncRequest = tdsForeignAsyncRequest;
+    fdwroutine->ForeignAsyncConfigureWait = tdsForeignAsyncConfigureWait;
+    fdwroutine->ForeignAsyncNotify = tdsForeignAsyncNotify;
+#endif  /* ASYNC_API */
+
     pqsignal(SIGINT, tds_signal_handler);
 
     #ifdef DEBUG
@@ -252,6 +390,9 @@ void _PG_init(void)
         NULL,
         NULL,
         NULL);
+
+    tdsEstimateCacheInit();
+    tdsServerStatsInit();
 }
 
 /*
@@ -447,6 +588,11 @@ bool tdsIsSqlServer(DBPROCESS *dbproc)
 {
     char *check_vendor_query = "SELECT CHARINDEX('Microsoft', @@version) AS is_sql_server";
     bool result = true;
+    TdsFdwConnState *state = tdsGetConnState(dbproc);
+
+    /* the vendor doesn't change during the life of a connection */
+    if (state != NULL && state->vendor_checked)
+        return state->is_sqlserver;
 
     if (!tdsExecuteQuery(check_vendor_query, dbproc))
         ereport(ERROR,
@@ -510,6 +656,12 @@ bool tdsIsSqlServer(DBPROCESS *dbproc)
         }
     }
 
+    if (state != NULL)
+    {
+        state->vendor_checked = true;
+        state->is_sqlserver = result;
+    }
+
     return result;
 }
 
@@ -778,13 +930,9 @@ int tdsSetupConnection(TdsFdwOptionSet* option_set, LOGINREC *login, DBPROCESS *
     return 0;
 }
 
-double tdsGetRowCountShowPlanAll(TdsFdwOptionSet* option_set, LOGINREC *login, DBPROCESS *dbproc)
+double tdsGetRowCountShowPlanAll(TdsFdwOptionSet* option_set, DBPROCESS *dbproc)
 {
     double rows = 0;
-    RETCODE erc;
-    int ret_code;
-    char* show_plan_query = "SET SHOWPLAN_ALL ON";
-    char* show_plan_query_off = "SET SHOWPLAN_ALL OFF";
     
     #ifdef DEBUG
         ereport(NOTICE,
@@ -792,6 +940,24 @@ double tdsGetRowCountShowPlanAll(TdsFdwOptionSet* option_set, LOGINREC *login, D
             ));
     #endif  
 
+    tdsGetRowCountsShowPlanAll(dbproc, 1, &option_set->query, &rows);
+
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> finishing tdsGetRowCountShowPlanAll")
+            ));
+    #endif      
+
+    return rows;
+}
+
+/* run a SET statement, which has to be the only statement of its batch */
+
+static void tdsSetShowPlanAll(DBPROCESS *dbproc, bool on)
+{
+    RETCODE erc;
+    char* show_plan_query = on ? "SET SHOWPLAN_ALL ON" : "SET SHOWPLAN_ALL OFF";
+
     ereport(DEBUG3,
         (errmsg("tds_fdw: Setting database command to %s", show_plan_query)
         ));
@@ -823,37 +989,70 @@ double tdsGetRowCountShowPlanAll(TdsFdwOptionSet* option_set, LOGINREC *login, D
         (errmsg("tds_fdw: Getting results")
         ));                 
     
-    erc = dbresults(dbproc);
-    
-    if (erc == FAIL)
+    while ((erc = dbresults(dbproc)) != NO_MORE_RESULTS)
     {
-        ereport(ERROR,
-            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-                errmsg("Failed to get results from query %s", show_plan_query)
-            ));
+        if (erc == FAIL)
+        {
+            ereport(ERROR,
+                (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                    errmsg("Failed to get results from query %s", show_plan_query)
+                ));
+        }
     }
+}
+
+/*
+ * get the estimated number of rows of several queries with SHOWPLAN_ALL.
+ *
+ * SQL Server wants SET SHOWPLAN_ALL alone in its batch, so that takes a
+ * round trip before and after, but all of the queries are sent in a single
+ * batch in between. Each of them returns one plan as its own result set,
+ * which are read in order into rows[].
+ */
+
+void tdsGetRowCountsShowPlanAll(DBPROCESS *dbproc, int nqueries, char **queries, double *rows)
+{
+    RETCODE erc;
+    int ret_code;
+    int i;
+    int nresults = 0;
     
-    ereport(DEBUG3,
-        (errmsg("tds_fdw: Setting database command to %s", option_set->query)
-        ));
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> starting tdsGetRowCountsShowPlanAll")
+            ));
+    #endif  
+
+    tdsSetShowPlanAll(dbproc, true);
     
-    if ((erc = dbcmd(dbproc, option_set->query)) == FAIL)
+    for (i = 0; i < nqueries; i++)
     {
-        ereport(ERROR,
-            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-                errmsg("Failed to set current query to %s", option_set->query)
-            ));     
+        rows[i] = 0;
+
+        ereport(DEBUG3,
+            (errmsg("tds_fdw: Adding query to batch: %s", queries[i])
+            ));
+        
+        /* dbcmd() appends to the batch, so separate the statements */
+        if ((i > 0 && dbcmd(dbproc, "\n") == FAIL) ||
+            (erc = dbcmd(dbproc, queries[i])) == FAIL)
+        {
+            ereport(ERROR,
+                (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                    errmsg("Failed to set current query to %s", queries[i])
+                ));     
+        }
     }
     
     ereport(DEBUG3,
-        (errmsg("tds_fdw: Executing the query")
+        (errmsg("tds_fdw: Executing the batch of %i queries", nqueries)
         ));
     
     if ((erc = dbsqlexec(dbproc)) == FAIL)
     {
         ereport(ERROR,
             (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-                errmsg("Failed to execute query %s", option_set->query)
+                errmsg("Failed to execute query %s", queries[0])
             )); 
     }
 
@@ -864,38 +1063,47 @@ double tdsGetRowCountShowPlanAll(TdsFdwOptionSet* option_set, LOGINREC *login, D
         (errmsg("tds_fdw: Getting results")
         ));             
 
-    erc = dbresults(dbproc);
-    
-    if (erc == FAIL)
-    {
-        ereport(ERROR,
-            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-                errmsg("Failed to get results from query %s", option_set->query)
-            ));
-    }
-    
-    else if (erc == NO_MORE_RESULTS)
-    {
-        ereport(DEBUG3,
-            (errmsg("tds_fdw: There appears to be no results from query %s", option_set->query)
-            ));
-        
-        goto cleanup_after_show_plan;
-    }
-    
-    else if (erc == SUCCEED)
+    while ((erc = dbresults(dbproc)) != NO_MORE_RESULTS)
     {
         int ncol;
         int ncols;
         int parent = 0;
         double estimate_rows = 0;
         
+        if (erc == FAIL)
+        {
+            ereport(ERROR,
+                (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                    errmsg("Failed to get results from query %s", queries[Min(nresults, nqueries - 1)])
+                ));
+        }
+        
+        else if (erc != SUCCEED)
+        {
+            ereport(ERROR,
+                (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                    errmsg("Unknown return code getting results from query %s", queries[Min(nresults, nqueries - 1)])
+                ));     
+        }
+        
         ncols = dbnumcols(dbproc);
         
         ereport(DEBUG3,
             (errmsg("tds_fdw: %i columns", ncols)
             ));
         
+        /* only the plans have columns */
+        if (ncols == 0)
+            continue;
+        
+        if (nresults >= nqueries)
+        {
+            ereport(ERROR,
+                (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                    errmsg("Got more plans than the %i queries that were sent", nqueries)
+                ));
+        }
+        
         for (ncol = 0; ncol < ncols; ncol++)
         {
             char *col_name;
@@ -953,7 +1161,7 @@ double tdsGetRowCountShowPlanAll(TdsFdwOptionSet* option_set, LOGINREC *login, D
                     
                     if (parent == 0)
                     {
-                        rows += estimate_rows;
+                        rows[nresults] += estimate_rows;
                     }
                         
                     break;
@@ -981,73 +1189,46 @@ double tdsGetRowCountShowPlanAll(TdsFdwOptionSet* option_set, LOGINREC *login, D
         }
         
         ereport(DEBUG3,
-            (errmsg("tds_fdw: We estimated %g rows.", rows)
+            (errmsg("tds_fdw: We estimated %g rows for query %s.", rows[nresults], queries[nresults])
             )); 
+        
+        nresults++;
     }
     
-    else
+    if (nresults < nqueries)
     {
-        ereport(ERROR,
-            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-                errmsg("Unknown return code getting results from query %s", option_set->query)
-            ));     
-    }
-    
-cleanup_after_show_plan:
         ereport(DEBUG3,
-            (errmsg("tds_fdw: Setting database command to %s", show_plan_query_off)
+            (errmsg("tds_fdw: There appear to be no results for %i of the queries", nqueries - nresults)
             ));
-    
-    if ((erc = dbcmd(dbproc, show_plan_query_off)) == FAIL)
-    {
-        ereport(ERROR,
-            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-                errmsg("Failed to set current query to %s", show_plan_query_off)
-            ));     
-    }
-    
-    ereport(DEBUG3,
-        (errmsg("tds_fdw: Executing the query")
-        ));
-    
-    if ((erc = dbsqlexec(dbproc)) == FAIL)
-    {
-        ereport(ERROR,
-            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-                errmsg("Failed to execute query %s", show_plan_query_off)
-            )); 
     }
     
-    ereport(DEBUG3,
-        (errmsg("tds_fdw: Query executed correctly")
-        ));
-    ereport(DEBUG3,
-        (errmsg("tds_fdw: Getting results")
-        ));             
-    
-    erc = dbresults(dbproc);
-    
-    if (erc == FAIL)
-    {
-        ereport(ERROR,
-            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-                errmsg("Failed to get results from query %s", show_plan_query)
-            ));
-    }   
+    tdsSetShowPlanAll(dbproc, false);
 
     #ifdef DEBUG
         ereport(NOTICE,
-            (errmsg("----> finishing tdsGetRowCountShowPlanAll")
+            (errmsg("----> finishing tdsGetRowCountsShowPlanAll")
             ));
     #endif      
-    
+}
 
-    return rows;
+/* has a remote estimate with estimate_timeout run out of time? */
+
+static bool tdsEstimateTimeIsUp(void)
+{
+    instr_time elapsed;
+
+    if (!estimate_timeout_active)
+        return false;
+
+    INSTR_TIME_SET_CURRENT(elapsed);
+    INSTR_TIME_SUBTRACT(elapsed, estimate_start);
+
+    return INSTR_TIME_GET_DOUBLE(elapsed) >= estimate_timeout;
 }
 
 /* get the number of rows returned by a query */
 
-double tdsGetRowCountExecute(TdsFdwOptionSet* option_set, LOGINREC *login, DBPROCESS *dbproc)
+double tdsGetRowCountExecute(TdsFdwOptionSet* option_set, DBPROCESS *dbproc)
 {
     int rows_report = 0;
     long long int rows_increment = 0;
@@ -1123,6 +1304,18 @@ double tdsGetRowCountExecute(TdsFdwOptionSet* option_set, LOGINREC *login, DBPRO
             {
                 case REG_ROW:
                     rows_increment++;
+
+                    /* dbsettime() only limits each read, not all of them */
+                    if (rows_increment % 1000 == 0 && tdsEstimateTimeIsUp())
+                    {
+                        dbcancel(dbproc);
+                        estimate_timed_out = true;
+
+                        ereport(ERROR,
+                            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                                errmsg("Remote estimate of query %s timed out", option_set->query)
+                            ));
+                    }
                     break;
                     
                 case BUF_FULL:
@@ -1184,40 +1377,221 @@ cleanup:
     }
 }
 
-double tdsGetRowCount(TdsFdwOptionSet* option_set, LOGINREC *login, DBPROCESS *dbproc)
+/*
+ * append the remote name of the table in option_set to buf, written the same
+ * way deparseRelation() does
+ */
+
+static void tdsAppendRemoteRelation(StringInfo buf, TdsFdwOptionSet* option_set)
+{
+    if (option_set->schema_name)
+        appendStringInfo(buf, "%s.%s", tds_quote_identifier(option_set->schema_name),
+            tds_quote_identifier(option_set->table_name));
+    else
+        appendStringInfoString(buf, option_set->table_name);
+}
+
+/*
+ * run a query that returns a single number, and return it. If the query
+ * doesn't return a row, default_value is returned.
+ */
+
+static double tdsQueryDouble(char *query, DBPROCESS *dbproc, double default_value)
 {
-    double rows = 0;
+    double value = default_value;
+
+    tdsQueryValue(query, dbproc, FLT8BIND, sizeof(double), (BYTE *) &value);
+
+    return value;
+}
+
+/*
+ * run a query that returns a single value, and bind it to the variable at
+ * varaddr. If the query doesn't return a row, the variable is left alone.
+ */
+
+static void tdsQueryValue(char *query, DBPROCESS *dbproc, int vartype, DBINT varlen, BYTE *varaddr)
+{
+    RETCODE erc;
+    int ret_code;
     
-    #ifdef DEBUG
-        ereport(NOTICE,
-            (errmsg("----> starting tdsGetRowCount")
+    if (!tdsExecuteQuery(query, dbproc))
+    {
+        ereport(ERROR,
+            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                errmsg("Failed to get results from query %s", query)
             ));
-    #endif      
+    }
     
-    if (strcmp(option_set->row_estimate_method, "execute") == 0)
+    erc = dbbind(dbproc, 1, vartype, varlen, varaddr);
+    
+    if (erc == FAIL)
     {
-        rows = tdsGetRowCountExecute(option_set, login, dbproc);
+        ereport(ERROR,
+            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                errmsg("Failed to bind results for query %s to a variable.", query)
+            ));
     }
     
-    else if (strcmp(option_set->row_estimate_method, "showplan_all") == 0)
+    while ((ret_code = dbnextrow(dbproc)) != NO_MORE_ROWS)
     {
-        rows = tdsGetRowCountShowPlanAll(option_set, login, dbproc);
+        switch (ret_code)
+        {
+            case REG_ROW:
+                break;
+                
+            case BUF_FULL:
+                ereport(ERROR,
+                    (errcode(ERRCODE_FDW_OUT_OF_MEMORY),
+                        errmsg("Buffer filled up while getting results for query %s", query)
+                    ));
+                break;
+                    
+            case FAIL:
+                ereport(ERROR,
+                    (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                        errmsg("Failed to get row while getting results for query %s", query)
+                    ));
+                break;
+            
+            default:
+                ereport(ERROR,
+                    (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                        errmsg("Failed to get results for query %s. Unknown return code.", query)
+                    ));
+        }
     }
+}
+
+/*
+ * get the number of rows in the table from the catalog statistics of the
+ * remote server, or -1 if they are not available (e.g. for a view)
+ */
+
+double tdsGetRowCountPartitionStats(TdsFdwOptionSet* option_set, DBPROCESS *dbproc)
+{
+    double rows;
+    StringInfoData relation;
+    StringInfoData stats_query;
+    const char *ptr;
+    bool is_sqlserver = tdsIsSqlServer(dbproc);
     
     #ifdef DEBUG
         ereport(NOTICE,
-            (errmsg("----> finishing tdsGetRowCount")
+            (errmsg("----> starting tdsGetRowCountPartitionStats")
             ));
-    #endif  
+    #endif
+    
+    initStringInfo(&relation);
+    tdsAppendRemoteRelation(&relation, option_set);
+    
+    /*
+     * Both servers take the name as a string for OBJECT_ID(), and return
+     * NULL for something that has no statistics, which ISNULL() turns into -1.
+     */
+    initStringInfo(&stats_query);
+    
+    if (is_sqlserver)
+        appendStringInfoString(&stats_query,
+            "SELECT ISNULL(SUM(CAST(p.rows AS FLOAT)), -1) FROM sys.partitions p "
+            "WHERE p.index_id IN (0, 1) AND p.object_id = OBJECT_ID('");
+    else
+        appendStringInfoString(&stats_query,
+            "SELECT ISNULL(CONVERT(FLOAT, row_count(DB_ID(), OBJECT_ID('");
+    
+    for (ptr = relation.data; *ptr; ptr++)
+    {
+        if (*ptr == '\'')
+            appendStringInfoChar(&stats_query, '\'');
+        appendStringInfoChar(&stats_query, *ptr);
+    }
+    
+    if (is_sqlserver)
+        appendStringInfoString(&stats_query, "')");
+    else
+        appendStringInfoString(&stats_query, "'))), -1)");
+    
+    rows = tdsQueryDouble(stats_query.data, dbproc, -1);
+    
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Statistics say table %s has %g rows.", relation.data, rows)
+        ));
+    
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> finishing tdsGetRowCountPartitionStats")
+            ));
+    #endif
+    
+    return rows;
+}
+
+/*
+ * get the number of rows returned by option_set->query with the configured
+ * row_estimate_method. remote_sel is the local estimate of the selectivity of
+ * the conditions sent to the remote server, used by methods that only know
+ * the size of the table.
+ */
+
+double tdsGetRowCount(TdsFdwOptionSet* option_set, DBPROCESS *dbproc, Selectivity remote_sel)
+{
+    double rows = 0;
+    
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> starting tdsGetRowCount")
+            ));
+    #endif      
+    
+    if (strcmp(option_set->row_estimate_method, "execute") == 0)
+    {
+        rows = tdsGetRowCountExecute(option_set, dbproc);
+    }
+    
+    else if (strcmp(option_set->row_estimate_method, "showplan_all") == 0)
+    {
+        rows = tdsGetRowCountShowPlanAll(option_set, dbproc);
+    }
+    
+    else if (strcmp(option_set->row_estimate_method, "partition_stats") == 0)
+    {
+        /* statistics only exist for tables, not for the query option */
+        if (option_set->table_name)
+            rows = tdsGetRowCountPartitionStats(option_set, dbproc);
+        else
+            rows = -1;
+        
+        if (rows >= 0)
+            rows = clamp_row_est(rows * remote_sel);
+        else
+        {
+            ereport(DEBUG3,
+                (errmsg("tds_fdw: No statistics available, executing the query instead")
+                ));
+            
+            rows = tdsGetRowCountExecute(option_set, dbproc);
+        }
+    }
+    
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> finishing tdsGetRowCount")
+            ));
+    #endif  
 
     return rows;
 }
 
-/* get the startup cost for the query */
+/*
+ * get the startup cost for the query: a round trip to the server, and a
+ * login if there is no cached connection to reuse
+ */
 
-double tdsGetStartupCost(TdsFdwOptionSet* option_set)
+double tdsGetStartupCost(Oid serverid, TdsFdwOptionSet* option_set)
 {
     double startup_cost;
+    double connect_ms;
+    double rtt_ms;
     
     #ifdef DEBUG
         ereport(NOTICE,
@@ -1225,7 +1599,21 @@ double tdsGetStartupCost(TdsFdwOptionSet* option_set)
             ));
     #endif  
     
-    if (strcmp(option_set->servername, "127.0.0.1") == 0 || strcmp(option_set->servername, "localhost") == 0)
+    if (tdsServerStatsGetLatency(serverid, &connect_ms, &rtt_ms))
+    {
+        startup_cost = rtt_ms * TDS_COST_PER_MS;
+
+        if (connect_ms > 0 && !tdsHaveCachedConnection(serverid))
+            startup_cost += connect_ms * TDS_COST_PER_MS;
+
+        ereport(DEBUG3,
+            (errmsg("tds_fdw: Network startup cost is %f, from a round trip time of %.3f ms",
+                startup_cost, rtt_ms)
+            ));
+    }
+
+    /* nothing was measured yet, so guess */
+    else if (strcmp(option_set->servername, "127.0.0.1") == 0 || strcmp(option_set->servername, "localhost") == 0)
         startup_cost = 0;
     else
         startup_cost = 25;
@@ -1239,7 +1627,142 @@ double tdsGetStartupCost(TdsFdwOptionSet* option_set)
     return startup_cost;
 }
 
-#if (PG_VERSION_NUM >= 90400)
+/*
+ * get the cost of sending a row of the given width over the network. Rows
+ * are streamed, so each one costs its share of the round trips it takes to
+ * send TDS_BYTES_PER_ROUND_TRIP bytes.
+ */
+
+double tdsGetTupleNetworkCost(Oid serverid, int width)
+{
+    double connect_ms;
+    double rtt_ms;
+
+    if (!tdsServerStatsGetLatency(serverid, &connect_ms, &rtt_ms))
+        return 0;
+
+    return rtt_ms * TDS_COST_PER_MS * Max(width, 1) / TDS_BYTES_PER_ROUND_TRIP;
+}
+
+#if (PG_VERSION_NUM >= 100000)
+
+/* DB-Library counts days from 1900-01-01, PostgreSQL from 2000-01-01 */
+#define TDS_EPOCH_JDATE 2415021
+
+/*
+ * Can tdsTemporalToDatum() convert this type of remote column to this type
+ * of local column?
+ */
+bool tdsCanConvertTemporal(int srctype, Oid attr_oid)
+{
+    switch (srctype)
+    {
+        case SYBDATETIME:
+        case SYBDATETIME4:
+#ifdef SYBMSDATETIME2
+        case SYBMSDATETIME2:
+#endif
+            return attr_oid == TIMESTAMPOID;
+#ifdef SYBMSDATETIME2
+        case SYBMSDATE:
+            return attr_oid == DATEOID;
+        case SYBMSTIME:
+            return attr_oid == TIMEOID;
+        case SYBMSDATETIMEOFFSET:
+            return attr_oid == TIMESTAMPTZOID || attr_oid == TIMESTAMPOID;
+#endif
+        default:
+            return false;
+    }
+}
+
+/*
+ * Convert a date or time value to a date, time, timestamp or timestamptz
+ * with integer arithmetic on the days and ticks that DB-Library keeps, and
+ * round it to the given typmod.
+ *
+ * DATETIME counts 1/300 seconds, which are rounded to milliseconds like
+ * SQL Server and dbdatecrack() do. SMALLDATETIME counts minutes. The types
+ * of TDS 7.3 count 100 nanoseconds, which are rounded to microseconds.
+ * DATETIMEOFFSET is kept in UTC, so its offset only matters for a local
+ * timestamp column, which gets the time as it was written.
+ */
+int tdsTemporalToDatum(int srctype, const BYTE *src, Oid attr_oid, int32 typmod, Datum *datum_out)
+{
+    int64 days;
+    int64 usecs;
+
+    switch (srctype)
+    {
+        case SYBDATETIME:
+        {
+            const DBDATETIME *dt = (const DBDATETIME *) src;
+
+            days = dt->dtdays;
+            usecs = (((int64) dt->dttime * 10 + 1) / 3) * INT64CONST(1000);
+            break;
+        }
+        case SYBDATETIME4:
+        {
+            const DBDATETIME4 *dt = (const DBDATETIME4 *) src;
+
+            days = dt->days;
+            usecs = dt->minutes * USECS_PER_MINUTE;
+            break;
+        }
+#ifdef SYBMSDATETIME2
+        case SYBMSDATE:
+        case SYBMSTIME:
+        case SYBMSDATETIME2:
+        case SYBMSDATETIMEOFFSET:
+        {
+            const DBDATETIMEALL *dt = (const DBDATETIMEALL *) src;
+
+            days = dt->date;
+            usecs = (int64) ((dt->time + 5) / 10);
+
+            if (dt->has_offset && attr_oid != TIMESTAMPTZOID)
+                usecs += dt->offset * USECS_PER_MINUTE;
+            break;
+        }
+#endif
+        default:
+            return FAIL;
+    }
+
+    days += TDS_EPOCH_JDATE - POSTGRES_EPOCH_JDATE;
+
+    switch (attr_oid)
+    {
+        case DATEOID:
+            *datum_out = DateADTGetDatum((DateADT) days);
+            return SUCCEED;
+        case TIMEOID:
+            *datum_out = TimeADTGetDatum((TimeADT) usecs);
+            if (typmod >= 0)
+                *datum_out = DirectFunctionCall2(time_scale, *datum_out, Int32GetDatum(typmod));
+            return SUCCEED;
+        case TIMESTAMPOID:
+            *datum_out = TimestampGetDatum((Timestamp) (days * USECS_PER_DAY + usecs));
+            if (typmod >= 0)
+                *datum_out = DirectFunctionCall2(timestamp_scale, *datum_out, Int32GetDatum(typmod));
+            return SUCCEED;
+        case TIMESTAMPTZOID:
+            *datum_out = TimestampTzGetDatum((TimestampTz) (days * USECS_PER_DAY + usecs));
+            if (typmod >= 0)
+                *datum_out = DirectFunctionCall2(timestamptz_scale, *datum_out, Int32GetDatum(typmod));
+            return SUCCEED;
+        default:
+            return FAIL;
+    }
+}
+
+int tdsDatetimeToDatum(DBPROCESS *dbproc, DBDATETIME *src, Datum *datetime_out)
+{
+    return tdsTemporalToDatum(SYBDATETIME, (const BYTE *) src, TIMESTAMPOID, -1, datetime_out);
+}
+
+#elif (PG_VERSION_NUM >= 90400)
 int tdsDatetimeToDatum(DBPROCESS *dbproc, DBDATETIME *src, Datum *datetime_out)
 {
     DBDATEREC datetime_in;
@@ -1252,15 +1775,11 @@ int tdsDatetimeToDatum(DBPROCESS *dbproc, DBDATETIME *src, Datum *datetime_out)
         #ifdef MSDBLIB
             seconds = (float8)datetime_in.second + ((float8)datetime_in.millisecond/1000);
                     
-            ereport(DEBUG3,
-                (errmsg("tds_fdw: Datetime value: year=%i, month=%i, day=%i, hour=%i, minute=%i, second=%i, millisecond=%i, timezone=%i,",
+            TDS_TRACE("Datetime value: year=%i, month=%i, day=%i, hour=%i, minute=%i, second=%i, millisecond=%i, timezone=%i,",
                     datetime_in.year, datetime_in.month, datetime_in.day, 
                     datetime_in.hour, datetime_in.minute, datetime_in.second,
-                    datetime_in.millisecond, datetime_in.tzone)
-                 ));
-            ereport(DEBUG3,
-                (errmsg("tds_fdw: Seconds=%f", seconds)
-                 ));
+                    datetime_in.millisecond, datetime_in.tzone);
+            TDS_TRACE("Seconds=%f", seconds);
                     
             *datetime_out = DirectFunctionCall6(make_timestamp, 
                  Int64GetDatum(datetime_in.year), Int64GetDatum(datetime_in.month), Int64GetDatum(datetime_in.day), 
@@ -1268,15 +1787,11 @@ int tdsDatetimeToDatum(DBPROCESS *dbproc, DBDATETIME *src, Datum *datetime_out)
         #else
             seconds = (float8)datetime_in.datesecond + ((float8)datetime_in.datemsecond/1000);
                     
-            ereport(DEBUG3,
-                (errmsg("tds_fdw: Datetime value: year=%i, month=%i, day=%i, hour=%i, minute=%i, second=%i, millisecond=%i, timezone=%i,",
+            TDS_TRACE("Datetime value: year=%i, month=%i, day=%i, hour=%i, minute=%i, second=%i, millisecond=%i, timezone=%i,",
                     datetime_in.dateyear, datetime_in.datemonth + 1, datetime_in.datedmonth, 
                     datetime_in.datehour, datetime_in.dateminute, datetime_in.datesecond,
-                    datetime_in.datemsecond, datetime_in.datetzone)
-                 ));
-            ereport(DEBUG3,
-                (errmsg("tds_fdw: Seconds=%f", seconds)
-                 ));
+                    datetime_in.datemsecond, datetime_in.datetzone);
+            TDS_TRACE("Seconds=%f", seconds);
                     
             /* Sybase uses different field names, and it uses 0-11 for the month */
             *datetime_out = DirectFunctionCall6(make_timestamp, 
@@ -1289,6 +1804,228 @@ int tdsDatetimeToDatum(DBPROCESS *dbproc, DBDATETIME *src, Datum *datetime_out)
 }
 #endif
 
+/*
+ * Make a varchar, bpchar or name from the bytes of a character column. The
+ * length checks and blank-padding are those of varcharin(), bpcharin() and
+ * namein(), done on the source bytes instead of a C string copy of them.
+ */
+Datum tdsCharToDatum(const char *src, DBINT srclen, Oid attr_oid, int32 typmod)
+{
+    size_t len = srclen;
+    size_t maxlen;
+    size_t j;
+    BpChar *result;
+
+    switch (attr_oid)
+    {
+        case NAMEOID:
+        {
+            Name name = (Name) palloc0(NAMEDATALEN);
+
+            if (len >= NAMEDATALEN)
+                len = pg_mbcliplen(src, len, NAMEDATALEN - 1);
+
+            memcpy(NameStr(*name), src, len);
+
+            return NameGetDatum(name);
+        }
+
+        case VARCHAROID:
+            maxlen = typmod - VARHDRSZ;
+
+            /* trailing spaces beyond the length are cut off silently */
+            if (typmod >= (int32) VARHDRSZ && len > maxlen)
+            {
+                size_t mbmaxlen = pg_mbcharcliplen(src, len, maxlen);
+
+                for (j = mbmaxlen; j < len; j++)
+                {
+                    if (src[j] != ' ')
+                        ereport(ERROR,
+                            (errcode(ERRCODE_STRING_DATA_RIGHT_TRUNCATION),
+                             errmsg("value too long for type character varying(%d)",
+                                (int) maxlen)));
+                }
+
+                len = mbmaxlen;
+            }
+
+            return PointerGetDatum(cstring_to_text_with_len(src, len));
+
+        default:
+            Assert(attr_oid == BPCHAROID);
+
+            if (typmod < (int32) VARHDRSZ)
+                maxlen = len;
+            else
+            {
+                size_t charlen = pg_mbstrlen_with_len(src, len);
+
+                maxlen = typmod - VARHDRSZ;
+
+                if (charlen > maxlen)
+                {
+                    size_t mbmaxlen = pg_mbcharcliplen(src, len, maxlen);
+
+                    for (j = mbmaxlen; j < len; j++)
+                    {
+                        if (src[j] != ' ')
+                            ereport(ERROR,
+                                (errcode(ERRCODE_STRING_DATA_RIGHT_TRUNCATION),
+                                 errmsg("value too long for type character(%d)",
+                                    (int) maxlen)));
+                    }
+
+                    maxlen = len = mbmaxlen;
+                }
+                else
+                {
+                    /* blank-pad to the length in characters */
+                    maxlen = len + (maxlen - charlen);
+                }
+            }
+
+            result = (BpChar *) palloc(maxlen + VARHDRSZ);
+            SET_VARSIZE(result, maxlen + VARHDRSZ);
+            memcpy(VARDATA(result), src, len);
+
+            if (maxlen > len)
+                memset(VARDATA(result) + len, ' ', maxlen - len);
+
+            return PointerGetDatum(result);
+    }
+}
+
+/*
+ * Convert a UNIQUEIDENTIFIER to a uuid. SQL Server keeps a GUID as a 32-bit
+ * and two 16-bit integers, which DB-Library hands over in host byte order,
+ * followed by 8 bytes. A uuid is all bytes in big-endian order.
+ */
+int tdsUniqueToUuidDatum(const BYTE *src, DBINT srclen, Datum *uuid_out)
+{
+    unsigned char *uuid;
+    uint32 data1;
+    uint16 data2;
+    uint16 data3;
+
+    if (srclen != 16)
+        return FAIL;
+
+    memcpy(&data1, src, sizeof(data1));
+    memcpy(&data2, src + 4, sizeof(data2));
+    memcpy(&data3, src + 6, sizeof(data3));
+
+    uuid = palloc(16);
+    uuid[0] = (data1 >> 24) & 0xFF;
+    uuid[1] = (data1 >> 16) & 0xFF;
+    uuid[2] = (data1 >> 8) & 0xFF;
+    uuid[3] = data1 & 0xFF;
+    uuid[4] = (data2 >> 8) & 0xFF;
+    uuid[5] = data2 & 0xFF;
+    uuid[6] = (data3 >> 8) & 0xFF;
+    uuid[7] = data3 & 0xFF;
+    memcpy(uuid + 8, src + 8, 8);
+
+    *uuid_out = PointerGetDatum(uuid);
+
+    return SUCCEED;
+}
+
+/* MONEY and SMALLMONEY values are integers, in ten-thousandths */
+static int64 tdsMoneyToInt64(int srctype, const BYTE *src)
+{
+    if (srctype == SYBMONEY4)
+        return ((const DBMONEY4 *) src)->mny4;
+    else
+    {
+        const DBMONEY *money = (const DBMONEY *) src;
+
+        return (int64) (((uint64) (uint32) money->mnyhigh << 32) | money->mnylow);
+    }
+}
+
+#if (PG_VERSION_NUM >= 140000)
+/*
+ * Convert a DECIMAL, NUMERIC, MONEY or SMALLMONEY value to a numeric with
+ * the given typmod, without printing and parsing it. DB-Library keeps a
+ * DECIMAL or NUMERIC value as a sign byte (1 for negative) followed by the
+ * absolute value in big-endian order, in as few bytes as the precision
+ * allows. Values too large for int64 arithmetic return FAIL, and have to be
+ * converted as text.
+ */
+int tdsNumericToDatum(int srctype, const BYTE *src, int32 typmod, Datum *numeric_out)
+{
+    int64 value;
+    int scale;
+
+    if (srctype == SYBMONEY || srctype == SYBMONEY4)
+    {
+        value = tdsMoneyToInt64(srctype, src);
+        scale = 4;
+    }
+    else
+    {
+        const DBNUMERIC *num = (const DBNUMERIC *) src;
+        int nbytes;
+        uint64 magnitude = 0;
+        int i;
+
+        if (num->precision > 18 || num->scale > num->precision)
+            return FAIL;
+
+        nbytes = (int) ceil(num->precision * log2(10.0) / 8);
+
+        for (i = 1; i <= nbytes; i++)
+            magnitude = (magnitude << 8) | num->array[i];
+
+        value = num->array[0] == 1 ? -(int64) magnitude : (int64) magnitude;
+        scale = num->scale;
+    }
+
+    *numeric_out = NumericGetDatum(int64_div_fast_to_numeric(value, scale));
+
+    if (typmod >= 0)
+        *numeric_out = DirectFunctionCall2(numeric, *numeric_out, Int32GetDatum(typmod));
+
+    return SUCCEED;
+}
+#endif
+
+/*
+ * Convert a MONEY or SMALLMONEY value to money, rounding to the fractional
+ * digits of lc_monetary the way cash_in() does. Returns FAIL if the locale
+ * has more than four fractional digits.
+ */
+int tdsMoneyToCashDatum(int srctype, const BYTE *src, Datum *cash_out)
+{
+    int64 value = tdsMoneyToInt64(srctype, src);
+    int fpoint = PGLC_localeconv()->frac_digits;
+    int64 divisor = 1;
+    int64 remainder;
+
+    /* same as cash_in() */
+    if (fpoint < 0 || fpoint > 10)
+        fpoint = 2;
+
+    if (fpoint > 4)
+        return FAIL;
+
+    for (; fpoint < 4; fpoint++)
+        divisor *= 10;
+
+    remainder = value % divisor;
+    value /= divisor;
+
+    if (remainder >= (divisor + 1) / 2)
+        value++;
+    else if (-remainder >= (divisor + 1) / 2)
+        value--;
+
+    *cash_out = Int64GetDatum(value);
+
+    return SUCCEED;
+}
+
 char* tdsConvertToCString(DBPROCESS* dbproc, int srctype, const BYTE* src, DBINT srclen)
 {
     char* dest = NULL;
@@ -1349,12 +2086,8 @@ char* tdsConvertToCString(DBPROCESS* dbproc, int srctype, const BYTE* src, DBINT
             break;
     }
     
-    ereport(DEBUG3,
-        (errmsg("tds_fdw: Source type is %i. Destination type is %i", srctype, desttype)
-        ));
-    ereport(DEBUG3,
-        (errmsg("tds_fdw: Source length is %i. Destination length is %i. Real destination length is %i", srclen, destlen, real_destlen)
-        ));
+    TDS_TRACE("Source type is %i. Destination type is %i", srctype, desttype);
+    TDS_TRACE("Source length is %i. Destination length is %i. Real destination length is %i", srclen, destlen, real_destlen);
     
     if (use_tds_conversion)
     {
@@ -1411,6 +2144,8 @@ void tdsExplainForeignScan(ForeignScanState *node, ExplainState *es)
         ExplainPropertyBool("Use remote estimate", option_set.use_remote_estimate, es);
         ExplainPropertyInteger("Local tuple estimate", NULL, option_set.local_tuple_estimate, es);
         ExplainPropertyText("Row estimate method", option_set.row_estimate_method, es);
+        if (festate->range_column)
+            ExplainPropertyText("Partition column", festate->range_column, es);
     }
     
     #ifdef DEBUG
@@ -1425,11 +2160,11 @@ void tdsExplainForeignScan(ForeignScanState *node, ExplainState *es)
 void tdsBeginForeignScan(ForeignScanState *node, int eflags)
 {
     TdsFdwOptionSet option_set;
-    LOGINREC *login;
     DBPROCESS *dbproc;
     TdsFdwExecutionState *festate;
     ForeignScan *fsplan = (ForeignScan *) node->ss.ps.plan;
     EState *estate = node->ss.ps.state;
+    Oid relid = RelationGetRelid(node->ss.ss_currentRelation);
     
     #ifdef DEBUG
         ereport(NOTICE,
@@ -1439,76 +2174,73 @@ void tdsBeginForeignScan(ForeignScanState *node, int eflags)
     
     tds_clear_signals();
     
-    tdsGetForeignTableOptionsFromCatalog(RelationGetRelid(node->ss.ss_currentRelation), &option_set);
-        
-    ereport(DEBUG3,
-        (errmsg("tds_fdw: Initiating DB-Library")
-        ));
-    
-    if (dbinit() == FAIL)
-    {
-        ereport(ERROR,
-            (errcode(ERRCODE_FDW_OUT_OF_MEMORY),
-                errmsg("Failed to initialize DB-Library environment")
-            ));
-    }
-    
-    dberrhandle(tds_err_handler);
-    
-    if (option_set.msg_handler)
-    {
-        if (strcmp(option_set.msg_handler, "notice") == 0)
-        {
-            dbmsghandle(tds_notice_msg_handler);
-        }
-        
-        else if (strcmp(option_set.msg_handler, "blackhole") == 0)
-        {
-            dbmsghandle(tds_blackhole_msg_handler);
-        }
-        
-        else
-        {
-            ereport(ERROR,
-                (errcode(ERRCODE_SYNTAX_ERROR),
-                    errmsg("Unknown msg handler: %s.", option_set.msg_handler)
-                ));
-        }
-    }
-    
-    ereport(DEBUG3,
-        (errmsg("tds_fdw: Getting login structure")
-        ));
-    
-    if ((login = dblogin()) == NULL)
-    {
-        ereport(ERROR,
-            (errcode(ERRCODE_FDW_OUT_OF_MEMORY),
-                errmsg("Failed to initialize DB-Library login structure")
-            ));
-    }
+    tdsGetForeignTableOptionsFromCatalog(relid, &option_set);
     
-    if (tdsSetupConnection(&option_set, login, &dbproc) != 0)
-    {
-        goto cleanup;
-    }
+    dbproc = tdsGetConnection(GetForeignTable(relid)->serverid, &option_set);
     
     festate = (TdsFdwExecutionState *) palloc(sizeof(TdsFdwExecutionState));
     node->fdw_state = (void *) festate;
-    festate->login = login;
     festate->dbproc = dbproc;
     festate->query = strVal(list_nth(fsplan->fdw_private,
                                      FdwScanPrivateSelectSql));
     festate->retrieved_attrs = (List *) list_nth(fsplan->fdw_private,
                                                FdwScanPrivateRetrievedAttrs);
     festate->first = 1;
+    festate->query_sent = false;
     festate->row = 0;
+    festate->fetch_size = option_set.fetch_size;
+    festate->batch_rows = 0;
+    festate->batch_next = 0;
+    festate->batch_status = REG_ROW;
+    festate->max_lob_size = option_set.max_lob_size;
+    festate->truncate_lobs = option_set.truncate_lobs;
     festate->mem_cxt = AllocSetContextCreate(estate->es_query_cxt,
                                                "tds_fdw data",
                                                ALLOCSET_DEFAULT_SIZES);
-    
-cleanup:
-    ;
+    /* not a child of mem_cxt, which is reset when the query is executed */
+    festate->row_cxt = AllocSetContextCreate(estate->es_query_cxt,
+                                               "tds_fdw row data",
+                                               ALLOCSET_DEFAULT_SIZES);
+    festate->serverid = GetForeignTable(relid)->serverid;
+    festate->executions = 0;
+    festate->time_startup = false;
+    INSTR_TIME_SET_ZERO(festate->startup_time);
+    INSTR_TIME_SET_ZERO(festate->fetch_time);
+    festate->bytes = 0;
+    festate->null_values = 0;
+    festate->input_values = 0;
+    festate->range_column = NULL;
+    festate->pscan = NULL;
+    festate->nranges = 0;
+    festate->ranges = 0;
+
+#ifdef PARALLEL_API
+    /* the range predicates are added to the query, once the ranges are known */
+    if (fsplan->scan.plan.parallel_aware)
+    {
+        festate->range_column = strVal(list_nth(fsplan->fdw_private,
+                                                FdwScanPrivateRangeColumn));
+        festate->range_has_where = intVal(list_nth(fsplan->fdw_private,
+                                                   FdwScanPrivateRangeHasWhere)) ? true : false;
+        festate->base_query = festate->query;
+        initStringInfo(&festate->range_query);
+    }
+#endif  /* PARALLEL_API */
+
+    /*
+     * With early_dispatch, the remote server starts on the query right away,
+     * while the rest of the plan is set up and run, e.g. the inner side of a
+     * hash join is hashed. The first row then only waits for the results.
+     * A parallel scan has no query before it takes a range.
+     */
+    if (option_set.early_dispatch && !festate->range_column &&
+        !(eflags & EXEC_FLAG_EXPLAIN_ONLY))
+    {
+        tdsSendQuery(festate);
+
+        /* the wait for the results includes local work, so don't time it */
+        festate->time_startup = false;
+    }
     
     #ifdef DEBUG
         ereport(NOTICE,
@@ -1553,8 +2285,6 @@ void tdsGetColumnMetadata(ForeignScanState *node, TdsFdwOptionSet *option_set)
     }
 
     festate->columns = palloc(festate->ncols * sizeof(COL));
-    festate->datums =  palloc(festate->attinmeta->tupdesc->natts * sizeof(*festate->datums));
-    festate->isnull =  palloc(festate->attinmeta->tupdesc->natts * sizeof(*festate->isnull));
 
     if (option_set->match_column_names)
     {
@@ -1566,6 +2296,7 @@ void tdsGetColumnMetadata(ForeignScanState *node, TdsFdwOptionSet *option_set)
         COL* column;
         
         column = &festate->columns[ncol];
+        column->colnum = ncol + 1;
         column->name = dbcolname(festate->dbproc, ncol + 1);
         
         ereport(DEBUG3,
@@ -1689,8 +2420,7 @@ void tdsGetColumnMetadata(ForeignScanState *node, TdsFdwOptionSet *option_set)
                     TupleDescAttr(festate->attinmeta->tupdesc, ncol)->attname.data)
                 ));
 
-                /* pretend this is NULL, so Pg won't try to access an invalid Datum */
-                festate->isnull[ncol] = 1;
+                /* tdsIterateForeignScan() leaves it NULL */
             }
         }
 
@@ -1700,981 +2430,1130 @@ void tdsGetColumnMetadata(ForeignScanState *node, TdsFdwOptionSet *option_set)
     MemoryContextSwitchTo(old_cxt);
 }
 
-/* get next row from foreign table */
-
-TupleTableSlot* tdsIterateForeignScan(ForeignScanState *node)
+/*
+ * Bind the fetched columns that are stored directly, and pick a decoder for
+ * each column that goes into the slot. This is done once per query, so that
+ * fetching a row is just a call per needed column.
+ */
+static void tdsBindColumns(TdsFdwExecutionState *festate)
 {
-    TdsFdwOptionSet option_set;
-    RETCODE erc;
-    int ret_code;
-    HeapTuple tuple;
-    TdsFdwExecutionState *festate = (TdsFdwExecutionState *) node->fdw_state;
-    EState *estate = node->ss.ps.state;
-    TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+    MemoryContext old_cxt;
     int ncol;
 
-    /* Cleanup */
-    ExecClearTuple(slot);
-    
-    #ifdef DEBUG
-        ereport(NOTICE,
-            (errmsg("----> starting tdsIterateForeignScan")
-            ));
-    #endif
-    
-    if (festate->first)
+    old_cxt = MemoryContextSwitchTo(festate->mem_cxt);
+
+    festate->decode_columns = palloc(festate->ncols * sizeof(COL *));
+    festate->ndecode_columns = 0;
+
+    for (ncol = 0; ncol < festate->ncols; ncol++)
     {
-        ereport(DEBUG3,
-            (errmsg("tds_fdw: This is the first iteration")
-            ));
-        ereport(DEBUG3,
-            (errmsg("tds_fdw: Setting database command to %s", festate->query)
-            ));
-        
-        festate->first = 0;
+        COL *column = &festate->columns[ncol];
+        const int srctype = column->srctype;
+        const Oid attr_oid = column->attr_oid;
+        RETCODE erc = SUCCEED;
 
-        /* the following option is needed to get a proper size for blobs */
-        if ((erc = dbsetopt(festate->dbproc, DBTEXTSIZE, "2147483647", -1)) == FAIL)
+        if (column->local_index == -1)
         {
-            ereport(WARNING,
-                (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-                    errmsg("Failed to set DBTEXTLIMIT server option, blob sizes may be truncated!")
+            ereport(DEBUG3,
+                (errmsg("tds_fdw: Skipping column %s because it is not present in local table", column->name)
                 ));
-        }
 
-        if ((erc = dbcmd(festate->dbproc, festate->query)) == FAIL)
-        {
-            ereport(ERROR,
-                (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-                    errmsg("Failed to set current query to %s", festate->query)
-                ));
+            continue;
         }
-        
+
         ereport(DEBUG3,
-            (errmsg("tds_fdw: Executing the query")
+            (errmsg("tds_fdw: The foreign type is %i. The local type is %i.", srctype, attr_oid)
             ));
-        
-        if ((erc = dbsqlexec(festate->dbproc)) == FAIL)
+
+        column->typmod = festate->attinmeta->atttypmods[column->local_index];
+        column->decode = tdsDecodeInput;
+
+        if ((srctype == SYBINT2 || srctype == SYBINT1) && attr_oid == INT2OID)
         {
-            ereport(ERROR,
-                (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-                    errmsg("Failed to execute query %s", festate->query)
-                ));
+            erc = dbbind(festate->dbproc, column->colnum, SMALLBIND, sizeof(DBSMALLINT), (BYTE *)(&column->value.dbsmallint));
+            column->decode = tdsDecodeInt2;
+        }
+        else if (srctype == SYBBIT && attr_oid == BOOLOID)
+        {
+            erc = dbbind(festate->dbproc, column->colnum, BITBIND, sizeof(DBBIT), (BYTE *)(&column->value.dbbit));
+            column->decode = tdsDecodeBool;
+        }
+        else if (srctype == SYBUNIQUE && attr_oid == UUIDOID)
+        {
+            column->decode = tdsDecodeUuid;
+        }
+        else if (srctype == SYBINT4 && attr_oid == INT4OID)
+        {
+            erc = dbbind(festate->dbproc, column->colnum, INTBIND, sizeof(DBINT), (BYTE *)(&column->value.dbint));
+            column->decode = tdsDecodeInt4;
+        }
+        else if (srctype == SYBINT8 && attr_oid == INT8OID)
+        {
+            erc = dbbind(festate->dbproc, column->colnum, BIGINTBIND, sizeof(DBBIGINT), (BYTE *)(&column->value.dbbigint));
+            column->decode = tdsDecodeInt8;
+        }
+        else if (srctype == SYBREAL && attr_oid == FLOAT4OID)
+        {
+            erc = dbbind(festate->dbproc, column->colnum, REALBIND, sizeof(DBREAL), (BYTE *)(&column->value.dbreal));
+            column->decode = tdsDecodeFloat4;
+        }
+        else if (srctype == SYBFLT8 && attr_oid == FLOAT8OID)
+        {
+            erc = dbbind(festate->dbproc, column->colnum, FLT8BIND, sizeof(DBFLT8), (BYTE *)(&column->value.dbflt8));
+            column->decode = tdsDecodeFloat8;
+        }
+        else if ((srctype == SYBCHAR || srctype == SYBVARCHAR || srctype == SYBTEXT) &&
+             (attr_oid == TEXTOID))
+        {
+            column->decode = tdsDecodeText;
+        }
+        else if ((srctype == SYBCHAR || srctype == SYBVARCHAR || srctype == SYBTEXT) &&
+             (attr_oid == VARCHAROID || attr_oid == BPCHAROID || attr_oid == NAMEOID))
+        {
+            column->decode = tdsDecodeChar;
+        }
+        else if ((srctype == SYBBINARY || srctype == SYBVARBINARY || srctype == SYBIMAGE) &&
+             (attr_oid == BYTEAOID))
+        {
+            column->decode = tdsDecodeBytea;
+        }
+        #if (PG_VERSION_NUM >= 100000)
+        else if (tdsCanConvertTemporal(srctype, attr_oid))
+        {
+            column->decode = tdsDecodeTemporal;
+        }
+        #elif (PG_VERSION_NUM >= 90400)
+        else if (srctype == SYBDATETIME && attr_oid == TIMESTAMPOID)
+        {
+            column->decode = tdsDecodeDatetime;
+        }
+        #endif
+        #if (PG_VERSION_NUM >= 140000)
+        else if ((srctype == SYBNUMERIC || srctype == SYBDECIMAL ||
+                  srctype == SYBMONEY || srctype == SYBMONEY4) &&
+             (attr_oid == NUMERICOID))
+        {
+            column->decode = tdsDecodeNumeric;
+        }
+        #endif
+        else if ((srctype == SYBMONEY || srctype == SYBMONEY4) &&
+             (attr_oid == CASHOID))
+        {
+            column->decode = tdsDecodeCash;
         }
 
-        ereport(DEBUG3,
-            (errmsg("tds_fdw: Query executed correctly")
-            ));
-        ereport(DEBUG3,
-            (errmsg("tds_fdw: Getting results")
-            ));             
-
-        erc = dbresults(festate->dbproc);
-        
         if (erc == FAIL)
         {
             ereport(ERROR,
                 (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-                    errmsg("Failed to get results from query %s", festate->query)
-                ));
+                 errmsg("Failed to bind results for column %s to a variable.",
+                    column->name)));
         }
-        
-        else if (erc == NO_MORE_RESULTS)
+
+        /* values of text and image columns may have to be checked first */
+        if (festate->max_lob_size > 0 && (srctype == SYBTEXT || srctype == SYBIMAGE))
         {
-            ereport(ERROR,
-                (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-                    errmsg("There appears to be no results from query %s", festate->query)
-                ));
+            column->lob_decode = column->decode;
+            column->decode = tdsDecodeLob;
         }
-        
-        else if (erc == SUCCEED)
-        {
-            Oid relOid;
 
-            ereport(DEBUG3,
-                (errmsg("tds_fdw: Successfully got results")
-                ));
+        festate->decode_columns[festate->ndecode_columns++] = column;
+    }
 
-            ereport(DEBUG3,
-                (errmsg("tds_fdw: Getting column info")
-                ));
+    MemoryContextSwitchTo(old_cxt);
+}
 
-            festate->ncols = dbnumcols(festate->dbproc);
+static Datum tdsDecodeBool(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen)
+{
+    return BoolGetDatum(column->value.dbbit != 0);
+}
 
-            ereport(DEBUG3,
-                (errmsg("tds_fdw: %i columns", festate->ncols)
-                ));
+static Datum tdsDecodeInt2(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen)
+{
+    return Int16GetDatum(column->value.dbsmallint);
+}
 
-            MemoryContextReset(festate->mem_cxt);
-            
-            relOid = RelationGetRelid(node->ss.ss_currentRelation);
-            
-            ereport(DEBUG3,
-                (errmsg("tds_fdw: Table OID is %i", relOid)
-                ));
-            
-            tdsGetForeignTableOptionsFromCatalog(relOid, &option_set);  
-            tdsGetColumnMetadata(node, &option_set);
+static Datum tdsDecodeInt4(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen)
+{
+    return Int32GetDatum(column->value.dbint);
+}
 
-            for (ncol = 0; ncol < festate->ncols; ncol++) {
-                COL* column = &festate->columns[ncol];
-                const int srctype = column->srctype;
-                const Oid attr_oid = column->attr_oid;
+static Datum tdsDecodeInt8(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen)
+{
+    return Int64GetDatum(column->value.dbbigint);
+}
 
-                if (column->local_index == -1)
-                {
-                    continue;
-                }
+static Datum tdsDecodeFloat4(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen)
+{
+    return Float4GetDatum(column->value.dbreal);
+}
 
-                erc = SUCCEED;
-                column->useraw = false;
-                
-                ereport(DEBUG3,
-                    (errmsg("tds_fdw: The foreign type is %i. The local type is %i.", srctype, attr_oid)
-                    )); 
+static Datum tdsDecodeFloat8(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen)
+{
+    return Float8GetDatum(column->value.dbflt8);
+}
 
-                if (srctype == SYBINT2 && attr_oid == INT2OID)
-                    {
-                    erc = dbbind(festate->dbproc, ncol + 1, SMALLBIND, sizeof(DBSMALLINT), (BYTE *)(&column->value.dbsmallint));
-                    column->useraw = true;
-                }
-                else if (srctype == SYBINT4 && attr_oid == INT4OID)
-                {
-                    erc = dbbind(festate->dbproc, ncol + 1, INTBIND, sizeof(DBINT), (BYTE *)(&column->value.dbint));
-                    column->useraw = true;
-                }
-                else if (srctype == SYBINT8 && attr_oid == INT8OID)
-                {
-                    erc = dbbind(festate->dbproc, ncol + 1, BIGINTBIND, sizeof(DBBIGINT), (BYTE *)(&column->value.dbbigint));
-                    column->useraw = true;
-                }
-                else if (srctype == SYBREAL && attr_oid == FLOAT4OID)
-                {
-                    erc = dbbind(festate->dbproc, ncol + 1, REALBIND, sizeof(DBREAL), (BYTE *)(&column->value.dbreal));
-                    column->useraw = true;
-                }
-                else if (srctype == SYBFLT8 && attr_oid == FLOAT8OID)
-                {
-                    erc = dbbind(festate->dbproc, ncol + 1, FLT8BIND, sizeof(DBFLT8), (BYTE *)(&column->value.dbflt8));
-                    column->useraw = true;
-                }
-                else if ((srctype == SYBCHAR || srctype == SYBVARCHAR || srctype == SYBTEXT) &&
-                     (attr_oid == TEXTOID))
-                {
-                    column->useraw = true;
-                }
-                else if ((srctype == SYBBINARY || srctype == SYBVARBINARY || srctype == SYBIMAGE) &&
-                     (attr_oid == BYTEAOID))
-                {
-                    column->useraw = true;
-                }
-                #if (PG_VERSION_NUM >= 90400)
-                else if (srctype == SYBDATETIME && attr_oid == TIMESTAMPOID)
-                {
-                    column->useraw = true;
-                }
-                #endif
+static Datum tdsDecodeText(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen)
+{
+    return PointerGetDatum(cstring_to_text_with_len((char *) src, srclen));
+}
 
-                if (erc == FAIL)
-                {
-                    ereport(ERROR,
-                        (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-                         errmsg("Failed to bind results for column %s to a variable.",
-                            dbcolname(festate->dbproc, ncol + 1))));
-                }
-            }
-        }
-        
-        else
-        {
-            ereport(ERROR,
-                (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-                    errmsg("Unknown return code getting results from query %s", festate->query)
-                ));
-        }
+static Datum tdsDecodeChar(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen)
+{
+    return tdsCharToDatum((char *) src, srclen, column->attr_oid, column->typmod);
+}
+
+static Datum tdsDecodeBytea(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen)
+{
+    bytea *bytes = palloc(srclen + VARHDRSZ);
+
+    SET_VARSIZE(bytes, srclen + VARHDRSZ);
+    memcpy(VARDATA(bytes), src, srclen);
+
+    return PointerGetDatum(bytes);
+}
+
+static Datum tdsDecodeUuid(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen)
+{
+    Datum value;
+
+    if (tdsUniqueToUuidDatum(src, srclen, &value) != SUCCEED)
+        return tdsDecodeInput(festate, column, src, srclen);
+
+    return value;
+}
+
+#if (PG_VERSION_NUM >= 100000)
+static Datum tdsDecodeTemporal(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen)
+{
+    Datum value;
+
+    if (tdsTemporalToDatum(column->srctype, src, column->attr_oid, column->typmod, &value) != SUCCEED)
+    {
+        ereport(ERROR,
+            (errcode(ERRCODE_FDW_INVALID_ATTRIBUTE_VALUE),
+             errmsg("Possibly invalid date value")));
     }
-    
-    ereport(DEBUG3,
-        (errmsg("tds_fdw: Fetching next row")
-        ));
-    
-    if ((ret_code = dbnextrow(festate->dbproc)) != NO_MORE_ROWS)
+
+    return value;
+}
+#elif (PG_VERSION_NUM >= 90400)
+static Datum tdsDecodeDatetime(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen)
+{
+    Datum value;
+
+    if (tdsDatetimeToDatum(festate->dbproc, (DBDATETIME *) src, &value) != SUCCEED)
     {
-        switch (ret_code)
-        {
-            case REG_ROW:
-                festate->row++;
-                
-                ereport(DEBUG3,
-                    (errmsg("tds_fdw: Row %i fetched", festate->row)
-                    ));
-                
-                if (show_before_row_memory_stats)
-                {
-                    fprintf(stderr,"Showing memory statistics before row %d.\n", festate->row);
-                        
-                    MemoryContextStats(estate->es_query_cxt);
-                }
+        ereport(ERROR,
+            (errcode(ERRCODE_FDW_INVALID_ATTRIBUTE_VALUE),
+             errmsg("Possibly invalid date value")));
+    }
 
-                for (ncol = 0; ncol < festate->ncols; ncol++)
-                {
-                    COL* column;
-                    DBINT srclen;
-                    BYTE* src;
-                    char *cstring;
-                    Oid attr_oid;
-                    bytea *bytes;
+    return value;
+}
+#endif
 
-                    column = &festate->columns[ncol];
-                    attr_oid = column->attr_oid;
+#if (PG_VERSION_NUM >= 140000)
+static Datum tdsDecodeNumeric(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen)
+{
+    Datum value;
 
-                    if (column->local_index == -1)
-                    {
-                        ereport(DEBUG3,
-                            (errmsg("tds_fdw: Skipping column %s because it is not present in local table", column->name)
-                        ));
+    if (tdsNumericToDatum(column->srctype, src, column->typmod, &value) != SUCCEED)
+        return tdsDecodeInput(festate, column, src, srclen);
 
-                        continue;
-                    }
+    return value;
+}
+#endif
 
-                    srclen = dbdatlen(festate->dbproc, ncol + 1);
-                    
-                    ereport(DEBUG3,
-                        (errmsg("tds_fdw: %s: Data length is %i", column->name, srclen)
-                        ));             
-                    
-                    src = dbdata(festate->dbproc, ncol + 1);
+static Datum tdsDecodeCash(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen)
+{
+    Datum value;
 
-                    if (srclen == 0)
-                    {
-                        ereport(DEBUG3,
-                            (errmsg("tds_fdw: %s: Column value is NULL", column->name)
-                            ));
-                        
-                        festate->isnull[column->local_index] = true;
-                        continue;
-                    }
-                    else if (src == NULL)
-                    {
-                        ereport(DEBUG3,
-                            (errmsg("tds_fdw: %s: Column value pointer is NULL, but probably shouldn't be", column->name)
-                            ));
-                        festate->isnull[column->local_index] = true;
-                        continue;
-                    }
-                    else
-                    {
-                        festate->isnull[column->local_index] = false;
-                    }
+    if (tdsMoneyToCashDatum(column->srctype, src, &value) != SUCCEED)
+        return tdsDecodeInput(festate, column, src, srclen);
 
-                    if (column->useraw)
-                    {
-                        switch (attr_oid)
-                        {
-                        case INT2OID:
-                            festate->datums[column->local_index] = Int16GetDatum(column->value.dbsmallint);
-                            break;
-                        case INT4OID:
-                            festate->datums[column->local_index] = Int32GetDatum(column->value.dbint);
-                            break;
-                        case INT8OID:
-                            festate->datums[column->local_index] = Int64GetDatum(column->value.dbbigint);
-                            break;
-                        case FLOAT4OID:
-                            festate->datums[column->local_index] = Float4GetDatum(column->value.dbreal);
-                            break;
-                        case FLOAT8OID:
-                            festate->datums[column->local_index] = Float8GetDatum(column->value.dbflt8);
-                            break;
-                        case TEXTOID:
-                            festate->datums[column->local_index] = PointerGetDatum(cstring_to_text_with_len((char *)src, srclen));
-                            break;
-                        case BYTEAOID:
-                            bytes = palloc(srclen + VARHDRSZ);
-                            SET_VARSIZE(bytes, srclen + VARHDRSZ);
-                            memcpy(VARDATA(bytes), src, srclen);
-                            festate->datums[column->local_index] = PointerGetDatum(bytes);
-                            break;
-                        #if (PG_VERSION_NUM >= 90400)
-                        case TIMESTAMPOID:
-                            erc = tdsDatetimeToDatum(festate->dbproc, (DBDATETIME *)src, &festate->datums[column->local_index]);
-                            if (erc != SUCCEED)
-                            {
-                                ereport(ERROR,
-                                    (errcode(ERRCODE_FDW_INVALID_ATTRIBUTE_VALUE),
-                                     errmsg("Possibly invalid date value")));
-                            }
-                            break;
-                        #endif
-                        default:
-                            ereport(ERROR,
-                                (errcode(ERRCODE_FDW_ERROR),
-                                 errmsg("%s marked useraw but wrong type (internal tds_fdw error)",
-                                    dbcolname(festate->dbproc, ncol+1))));
-                            break;
-                        }
-                    }
-                    else
-                    {
-                        cstring = tdsConvertToCString(festate->dbproc, column->srctype, src, srclen);
-                        festate->datums[column->local_index] = InputFunctionCall(&festate->attinmeta->attinfuncs[column->local_index],
-                                              cstring,
-                                              festate->attinmeta->attioparams[column->local_index],
-                                              festate->attinmeta->atttypmods[column->local_index]);
-                    }
-                }
-                
-                if (show_after_row_memory_stats)
-                {
-                    fprintf(stderr,"Showing memory statistics after row %d.\n", festate->row);
-                        
-                    MemoryContextStats(estate->es_query_cxt);
-                }
+    return value;
+}
 
-                tuple = heap_form_tuple(node->ss.ss_currentRelation->rd_att, festate->datums, festate->isnull);
-#if PG_VERSION_NUM < 120000
-                ExecStoreTuple(tuple, slot, InvalidBuffer, false);
-#else
-                ExecStoreHeapTuple(tuple, slot, false);
-#endif              
-                break;
-                
-            case BUF_FULL:
-                ereport(ERROR,
-                    (errcode(ERRCODE_FDW_OUT_OF_MEMORY),
-                    errmsg("Buffer filled up during query")
-                    ));
-                break;
-                    
-            case FAIL:
-                ereport(ERROR,
-                    (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-                    errmsg("Failed to get row during query")
-                    ));
+/* anything else goes through text and the input function of the local type */
+static Datum tdsDecodeInput(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen)
+{
+    char *cstring = tdsConvertToCString(festate->dbproc, column->srctype, src, srclen);
+
+    festate->input_values++;
+
+    return InputFunctionCall(&festate->attinmeta->attinfuncs[column->local_index],
+        cstring,
+        festate->attinmeta->attioparams[column->local_index],
+        column->typmod);
+}
+
+/*
+ * Text and image values longer than max_lob_size are an error, or are cut
+ * off at the limit with truncate_lobs. Text is only cut off at a character
+ * boundary.
+ */
+static Datum tdsDecodeLob(TdsFdwExecutionState *festate, COL *column, BYTE *src, DBINT srclen)
+{
+    if (srclen > festate->max_lob_size)
+    {
+        if (!festate->truncate_lobs)
+            ereport(ERROR,
+                (errcode(ERRCODE_FDW_INVALID_STRING_LENGTH_OR_BUFFER_LENGTH),
+                 errmsg("Value of column %s is longer than max_lob_size (%d bytes)",
+                    column->name, festate->max_lob_size)));
+
+        if (column->srctype == SYBTEXT)
+            srclen = pg_mbcliplen((char *) src, srclen, festate->max_lob_size);
+        else
+            srclen = festate->max_lob_size;
+    }
+
+    return column->lob_decode(festate, column, src, srclen);
+}
+
+/*
+ * Make the next row of the query the current one. With fetch_size > 1,
+ * DB-Library's row buffer is used: a batch of up to fetch_size rows is read
+ * from the server in one go, and the rows are then made current one after
+ * another with dbgetrow(), which also fills the bound variables.
+ */
+static int tdsNextRow(TdsFdwExecutionState *festate)
+{
+    int ret_code;
+
+    if (festate->fetch_size <= 1)
+        return dbnextrow(festate->dbproc);
+
+    if (festate->batch_next == festate->batch_rows)
+    {
+        /* all rows of the batch were returned, so make room for more */
+        if (festate->batch_rows > 0)
+            dbclrbuf(festate->dbproc, festate->batch_rows);
+
+        festate->batch_rows = 0;
+        festate->batch_next = 0;
+
+        if (festate->batch_status != REG_ROW)
+            return festate->batch_status;
+
+        while (festate->batch_rows < festate->fetch_size)
+        {
+            ret_code = dbnextrow(festate->dbproc);
+
+            if (ret_code != REG_ROW)
+            {
+                /* returned once the rows read before are used up */
+                festate->batch_status = ret_code;
                 break;
-            
-            default:
-                ereport(ERROR,
-                    (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-                    errmsg("Failed to get row during query. Unknown return code.")
-                    ));
+            }
+
+            festate->batch_rows++;
         }
+
+        if (festate->batch_rows == 0)
+            return festate->batch_status;
+
+        festate->batch_first = DBFIRSTROW(festate->dbproc);
+
+        TDS_TRACE("Read %i rows into the row buffer", festate->batch_rows);
     }
-    
+
+    return dbgetrow(festate->dbproc, festate->batch_first + festate->batch_next++);
+}
+
+/*
+ * Whether the next row can be returned without waiting for the socket. Only
+ * the rows of the row buffer (fetch_size) are known to be complete. Data that
+ * DB-Library read from the network, but didn't process yet, may hold only a
+ * part of a row, and reading the rest then blocks. It is still reported as
+ * ready, as the socket won't become readable for data that was read already,
+ * and waiting for it could wait forever.
+ */
+static bool tdsRowReady(TdsFdwExecutionState *festate)
+{
+    /* rows left in the row buffer, or the end of the result, which was read */
+    if (festate->batch_next < festate->batch_rows || festate->batch_status != REG_ROW)
+        return true;
+
+    return DBRBUF(festate->dbproc) ? true : false;
+}
+
+/*
+ * In a parallel scan, take the next range of partition_column that no
+ * process of the scan took yet, and make festate->query the query for it.
+ * Returns false once all ranges are taken, and for other scans.
+ */
+static bool tdsNextRange(TdsFdwExecutionState *festate)
+{
+#ifdef PARALLEL_API
+    TdsFdwParallelScan *pscan = festate->pscan;
+    char *column = festate->range_column;
+    int64 lower;
+    int64 upper;
+    int range;
+
+    if (pscan == NULL)
+        return false;
+
+    SpinLockAcquire(&pscan->mutex);
+    range = pscan->next_range;
+    if (range < pscan->nranges)
+        pscan->next_range++;
+    SpinLockRelease(&pscan->mutex);
+
+    festate->nranges = pscan->nranges;
+
+    if (range >= pscan->nranges)
+        return false;
+
+    resetStringInfo(&festate->range_query);
+    appendStringInfoString(&festate->range_query, festate->base_query);
+
+    /*
+     * The first and the last range are open, so rows outside of the minimum
+     * and maximum read at the start of the scan, and NULLs, aren't missed.
+     */
+    if (pscan->nranges > 1)
+    {
+        /* no overflow, tdsInitializeDSMForeignScan() keeps the bounds up to the maximum */
+        lower = (int64) ((uint64) pscan->range_start + range * pscan->range_step);
+        upper = (int64) ((uint64) lower + pscan->range_step);
+
+        appendStringInfoString(&festate->range_query,
+            festate->range_has_where ? " AND " : " WHERE ");
+
+        if (range == 0)
+            appendStringInfo(&festate->range_query, "(%s < " INT64_FORMAT " OR %s IS NULL)",
+                column, upper, column);
+        else if (range == pscan->nranges - 1)
+            appendStringInfo(&festate->range_query, "(%s >= " INT64_FORMAT ")",
+                column, lower);
+        else
+            appendStringInfo(&festate->range_query, "(%s >= " INT64_FORMAT " AND %s < " INT64_FORMAT ")",
+                column, lower, column, upper);
+    }
+
+    festate->query = festate->range_query.data;
+    festate->ranges++;
+
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Scanning range %i of %i", range + 1, pscan->nranges)
+        ));
+
+    return true;
+#else
+    return false;
+#endif  /* PARALLEL_API */
+}
+
+/*
+ * Send the query of a scan to the remote server, without waiting for the
+ * answer. tdsOpenResults() waits for it.
+ */
+static void tdsSendQuery(TdsFdwExecutionState *festate)
+{
+    char textsize[12];
+
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Setting database command to %s", festate->query)
+        ));
+
+    /*
+     * The following option is needed to get a proper size for blobs. With
+     * max_lob_size, the server cuts off longer values, so they never take
+     * up memory here. nvarchar(max) and ntext are sent in UCS-2, so twice
+     * the limit is asked for, plus a character to notice longer values.
+     */
+    if (festate->max_lob_size > 0)
+        snprintf(textsize, sizeof(textsize), "%d", festate->max_lob_size * 2 + 2);
     else
+        snprintf(textsize, sizeof(textsize), "%d", 2147483647);
+
+    if (dbsetopt(festate->dbproc, DBTEXTSIZE, textsize, -1) == FAIL)
+    {
+        ereport(WARNING,
+            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                errmsg("Failed to set DBTEXTLIMIT server option, blob sizes may be truncated!")
+            ));
+    }
+
+    if (festate->fetch_size > 1)
     {
+        char fetch_size[12];
+
+        snprintf(fetch_size, sizeof(fetch_size), "%d", festate->fetch_size);
+
         ereport(DEBUG3,
-            (errmsg("tds_fdw: No more rows")
+            (errmsg("tds_fdw: Buffering %s rows at a time", fetch_size)
+            ));
+
+        if (dbsetopt(festate->dbproc, DBBUFFER, fetch_size, 0) == FAIL)
+        {
+            ereport(ERROR,
+                (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                    errmsg("Failed to set DBBUFFER option to %s rows", fetch_size)
+                ));
+        }
+    }
+
+    if (dbcmd(festate->dbproc, festate->query) == FAIL)
+    {
+        ereport(ERROR,
+            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                errmsg("Failed to set current query to %s", festate->query)
             ));
     }
     
-    #ifdef DEBUG
-        ereport(NOTICE,
-            (errmsg("----> finishing tdsIterateForeignScan")
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Sending the query")
+        ));
+    
+    festate->time_startup = true;
+    INSTR_TIME_SET_CURRENT(festate->query_start);
+
+    if (dbsqlsend(festate->dbproc) == FAIL)
+    {
+        ereport(ERROR,
+            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                errmsg("Failed to execute query %s", festate->query)
             ));
-    #endif
+    }
 
-    return slot;
+    festate->query_sent = true;
 }
 
-/* rescan foreign table */
-
-void tdsReScanForeignScan(ForeignScanState *node)
+/*
+ * Wait for the remote server to execute the query sent by tdsSendQuery(),
+ * then bind the columns of its result.
+ */
+static void tdsOpenResults(ForeignScanState *node)
 {
     TdsFdwExecutionState *festate = (TdsFdwExecutionState *) node->fdw_state;
-    int ret_code = NO_MORE_ROWS;
+    TdsFdwOptionSet option_set;
+    RETCODE erc;
+    instr_time duration;
 
-    #ifdef DEBUG
-        ereport(NOTICE,
-            (errmsg("----> starting tdsReScanForeignScan")
+    if (dbsqlok(festate->dbproc) == FAIL)
+    {
+        ereport(ERROR,
+            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                errmsg("Failed to execute query %s", festate->query)
             ));
-    #endif
+    }
+
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Query executed correctly")
+        ));
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Getting results")
+        ));             
+
+    erc = dbresults(festate->dbproc);
 
     /*
-     * Consume any remaining result rows.
-     * This might be necessary if the scan stopped before all
-     * rows were consumed.
+     * Only time queries that were sent right before, as the time since an
+     * early or asynchronous send includes local work and other scans.
      */
-    if (!festate->first)
-        while ((ret_code = dbnextrow(festate->dbproc)) == REG_ROW)
-            ;
-
-    if (ret_code != NO_MORE_ROWS)
+    if (festate->time_startup)
+    {
+        INSTR_TIME_SET_CURRENT(duration);
+        INSTR_TIME_SUBTRACT(duration, festate->query_start);
+        INSTR_TIME_ADD(festate->startup_time, duration);
+        festate->executions++;
+    }
+    
+    if (erc == FAIL)
+    {
         ereport(ERROR,
             (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-            errmsg("Failed to get row during query")
+                errmsg("Failed to get results from query %s", festate->query)
+            ));
+    }
+    
+    else if (erc == NO_MORE_RESULTS)
+    {
+        ereport(ERROR,
+            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                errmsg("There appears to be no results from query %s", festate->query)
             ));
+    }
+    
+    else if (erc == SUCCEED)
+    {
+        Oid relOid;
 
-    /* reset the state for the next scan */
-    festate->first = 1;
+        ereport(DEBUG3,
+            (errmsg("tds_fdw: Successfully got results")
+            ));
+
+        ereport(DEBUG3,
+            (errmsg("tds_fdw: Getting column info")
+            ));
+
+        festate->ncols = dbnumcols(festate->dbproc);
+
+        ereport(DEBUG3,
+            (errmsg("tds_fdw: %i columns", festate->ncols)
+            ));
+
+        MemoryContextReset(festate->mem_cxt);
+        
+        relOid = RelationGetRelid(node->ss.ss_currentRelation);
+        
+        ereport(DEBUG3,
+            (errmsg("tds_fdw: Table OID is %i", relOid)
+            ));
+        
+        tdsGetForeignTableOptionsFromCatalog(relOid, &option_set);  
+        tdsGetColumnMetadata(node, &option_set);
+
+        tdsBindColumns(festate);
+    }
     
-    #ifdef DEBUG
-        ereport(NOTICE,
-            (errmsg("----> finishing tdsReScanForeignScan")
+    else
+    {
+        ereport(ERROR,
+            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                errmsg("Unknown return code getting results from query %s", festate->query)
             ));
-    #endif
+    }
 }
 
-/* cleanup objects related to scan */
+/* get next row from foreign table */
 
-void tdsEndForeignScan(ForeignScanState *node)
+TupleTableSlot* tdsIterateForeignScan(ForeignScanState *node)
 {
-    MemoryContext old_cxt;
+    int ret_code;
     TdsFdwExecutionState *festate = (TdsFdwExecutionState *) node->fdw_state;
     EState *estate = node->ss.ps.state;
+    TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+    Datum *values = slot->tts_values;
+    bool *isnull = slot->tts_isnull;
+    MemoryContext old_cxt;
+    int ncol;
+    instr_time start;
+    instr_time duration;
+
+    /* Cleanup */
+    ExecClearTuple(slot);
     
     #ifdef DEBUG
         ereport(NOTICE,
-            (errmsg("----> starting tdsEndForeignScan")
+            (errmsg("----> starting tdsIterateForeignScan")
             ));
     #endif
     
-    old_cxt = MemoryContextSwitchTo(festate->mem_cxt);
-    
-    if (show_finished_memory_stats)
+    if (festate->first)
     {
-        fprintf(stderr,"Showing memory statistics after query finished.\n");
-            
-        MemoryContextStats(estate->es_query_cxt);
-    }
-    
-    ereport(DEBUG3,
-        (errmsg("tds_fdw: Closing database connection")
-        ));
-    
-    dbclose(festate->dbproc);
-    
-    ereport(DEBUG3,
-        (errmsg("tds_fdw: Freeing login structure")
-        ));
-    
-    dbloginfree(festate->login);
-    
-    ereport(DEBUG3,
-        (errmsg("tds_fdw: Closing DB-Library")
-        ));
-    
-    dbexit();
-    
-    #ifdef DEBUG
-        ereport(NOTICE,
-            (errmsg("----> finishing tdsEndForeignScan")
+        ereport(DEBUG3,
+            (errmsg("tds_fdw: This is the first iteration")
             ));
-    #endif
+        
+        festate->first = 0;
 
-    MemoryContextSwitchTo(old_cxt);
-    MemoryContextReset(festate->mem_cxt);
+        /* a parallel scan may find all ranges taken by the others */
+        if (festate->pscan == NULL || tdsNextRange(festate))
+        {
+            if (!festate->query_sent)
+                tdsSendQuery(festate);
+
+            tdsOpenResults(node);
+        }
+    }
     
-    tds_clear_signals();
-}
-
-/*
- * estimate_path_cost_size
- *      Get cost and size estimates for a foreign scan
- *
- * We assume that all the baserestrictinfo clauses will be applied, plus
- * any join clauses listed in join_conds.
- */
-static void
-estimate_path_cost_size(PlannerInfo *root,
-                        RelOptInfo *baserel,
-                        List *join_conds,
-                        List *pathkeys,
-                        double *p_rows, int *p_width,
-                        Cost *p_startup_cost, Cost *p_total_cost, TdsFdwOptionSet *option_set)
-{
-    TdsFdwRelationInfo *fpinfo = (TdsFdwRelationInfo *) baserel->fdw_private;
-    double      rows = 0.0;
-    double      retrieved_rows = 0.0;
-    int         width = 0;
-    Cost        startup_cost = 0;
-    Cost        total_cost = 0;
-    Cost        run_cost;
-    Cost        cpu_per_tuple;
+    TDS_TRACE("Fetching next row");
 
     /*
-     * If the table or the server is configured to use remote estimates,
-     * connect to the foreign server and execute EXPLAIN to estimate the
-     * number of rows selected by the restriction+join clauses.  Otherwise,
-     * estimate rows using whatever statistics we have locally, in a way
-     * similar to ordinary tables.
+     * The values of the previous row are gone from the slot now, so free
+     * them. Everything made for this row goes into row_cxt, so a scan uses
+     * the same memory however many rows it returns.
      */
-    if (fpinfo->use_remote_estimate)
+    MemoryContextReset(festate->row_cxt);
+    old_cxt = MemoryContextSwitchTo(festate->row_cxt);
+    
+    for (;;)
     {
-        LOGINREC *login;
-        DBPROCESS *dbproc;
-        Selectivity local_sel;
-        QualCost    local_cost;
-        List       *remote_join_conds;
-        List       *local_join_conds;
-        List       *usable_pathkeys = NIL;
-        ListCell   *lc;
-        List *retrieved_attrs;
-        
-        /*
-         * join_conds might contain both clauses that are safe to send across,
-         * and clauses that aren't.
-         */
-        classifyConditions(root, baserel, baserel->baserestrictinfo,
-                           &remote_join_conds, &local_join_conds);
-                           
-        /*
-         * Determine whether we can potentially push query pathkeys to the remote
-         * side, avoiding a local sort.
-         */
-        foreach(lc, pathkeys)
+        INSTR_TIME_SET_CURRENT(start);
+        ret_code = festate->query_sent ? tdsNextRow(festate) : NO_MORE_ROWS;
+        INSTR_TIME_SET_CURRENT(duration);
+        INSTR_TIME_SUBTRACT(duration, start);
+        INSTR_TIME_ADD(festate->fetch_time, duration);
+
+        /* in a parallel scan, go on with the next range once one is done */
+        if (ret_code != NO_MORE_ROWS || !tdsNextRange(festate))
+            break;
+
+        festate->batch_status = REG_ROW;
+        tdsSendQuery(festate);
+        tdsOpenResults(node);
+    }
+
+    if (ret_code != NO_MORE_ROWS)
+    {
+        switch (ret_code)
         {
-            PathKey    *pathkey = (PathKey *) lfirst(lc);
-            EquivalenceClass *pathkey_ec = pathkey->pk_eclass;
-            Expr       *em_expr;
+            case REG_ROW:
+                festate->row++;
+                
+                TDS_TRACE("Row %i fetched", festate->row);
+                
+                if (show_before_row_memory_stats)
+                {
+                    fprintf(stderr,"Showing memory statistics before row %d.\n", festate->row);
+                        
+                    MemoryContextStats(estate->es_query_cxt);
+                }
+
+                /* local columns that weren't fetched, or are NULL, stay NULL */
+                memset(isnull, true, slot->tts_tupleDescriptor->natts * sizeof(bool));
+
+                for (ncol = 0; ncol < festate->ndecode_columns; ncol++)
+                {
+                    COL *column = festate->decode_columns[ncol];
+                    DBINT srclen = dbdatlen(festate->dbproc, column->colnum);
+                    BYTE *src = dbdata(festate->dbproc, column->colnum);
+
+                    festate->bytes += srclen;
+
+                    /* a NULL pointer shouldn't happen, but is NULL as well */
+                    if (srclen == 0 || src == NULL)
+                    {
+                        TDS_TRACE("%s: Column value is NULL", column->name);
+                        festate->null_values++;
+                        continue;
+                    }
+
+                    TDS_TRACE("%s: Data length is %i", column->name, srclen);
+
+                    values[column->local_index] = column->decode(festate, column, src, srclen);
+                    isnull[column->local_index] = false;
+                }
+                
+                if (show_after_row_memory_stats)
+                {
+                    fprintf(stderr,"Showing memory statistics after row %d.\n", festate->row);
+                        
+                    MemoryContextStats(estate->es_query_cxt);
+                }
 
-            /*
-             * is_foreign_expr would detect volatile expressions as well, but
-             * ec_has_volatile saves some cycles.
-             */
-            if (!pathkey_ec->ec_has_volatile &&
-                (em_expr = find_em_expr_for_rel(pathkey_ec, baserel)) &&
-                is_foreign_expr(root, baserel, em_expr))
-                usable_pathkeys = lappend(usable_pathkeys, pathkey);
-            else
-            {
                 /*
-                 * The planner and executor don't have any clever strategy for
-                 * taking data sorted by a prefix of the query's pathkeys and
-                 * getting it to be sorted by all of those pathekeys.  We'll just
-                 * end up resorting the entire data set.  So, unless we can push
-                 * down all of the query pathkeys, forget it.
+                 * The values go straight into the slot. A heap tuple is only
+                 * made if a node above needs one.
                  */
-                list_free(usable_pathkeys);
-                usable_pathkeys = NIL;
+                ExecStoreVirtualTuple(slot);
+                break;
+                
+            case BUF_FULL:
+                ereport(ERROR,
+                    (errcode(ERRCODE_FDW_OUT_OF_MEMORY),
+                    errmsg("Buffer filled up during query")
+                    ));
+                break;
+                    
+            case FAIL:
+                ereport(ERROR,
+                    (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                    errmsg("Failed to get row during query")
+                    ));
                 break;
-            }
-        }
-        
-        tdsBuildForeignQuery(root, baserel, option_set, 
-            fpinfo->attrs_used, &retrieved_attrs,
-            fpinfo->remote_conds, remote_join_conds, usable_pathkeys);
-
-        /* Get the remote estimate */
-
-        ereport(DEBUG3,
-            (errmsg("tds_fdw: Initiating DB-Library")
-            ));
-        
-        if (dbinit() == FAIL)
-        {
-            ereport(ERROR,
-                (errcode(ERRCODE_FDW_OUT_OF_MEMORY),
-                    errmsg("Failed to initialize DB-Library environment")
-                ));
-            goto cleanup_before_init;
-        }
-        
-        dberrhandle(tds_err_handler);
-        
-        if (option_set->msg_handler)
-        {
-            if (strcmp(option_set->msg_handler, "notice") == 0)
-            {
-                dbmsghandle(tds_notice_msg_handler);
-            }
-            
-            else if (strcmp(option_set->msg_handler, "blackhole") == 0)
-            {
-                dbmsghandle(tds_blackhole_msg_handler);
-            }
             
-            else
-            {
+            default:
                 ereport(ERROR,
-                    (errcode(ERRCODE_SYNTAX_ERROR),
-                        errmsg("Unknown msg handler: %s.", option_set->msg_handler)
+                    (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                    errmsg("Failed to get row during query. Unknown return code.")
                     ));
-            }
-        }
-        
-        ereport(DEBUG3,
-            (errmsg("tds_fdw: Getting login structure")
-            ));
-        
-        if ((login = dblogin()) == NULL)
-        {
-            ereport(ERROR,
-                (errcode(ERRCODE_FDW_OUT_OF_MEMORY),
-                    errmsg("Failed to initialize DB-Library login structure")
-                ));
-            goto cleanup_before_login;
         }
-        
-        if (tdsSetupConnection(option_set, login, &dbproc) != 0)
-        {
-            goto cleanup;
-        }
-            
-        rows = tdsGetRowCount(option_set, login, dbproc);
-        retrieved_rows = rows;
-        
-        width = option_set->fdw_tuple_cost;
-        startup_cost = option_set->fdw_startup_cost;
-        total_cost = 0;
-
-        /* Factor in the selectivity of the locally-checked quals */
-        local_sel = clauselist_selectivity(root,
-                                           join_conds,
-                                           baserel->relid,
-                                           JOIN_INNER,
-                                           NULL);
-        local_sel *= fpinfo->local_conds_sel;
-
-        rows = clamp_row_est(rows * local_sel);
-
-        /* Add in the eval cost of the locally-checked quals */
-        startup_cost += fpinfo->local_conds_cost.startup;
-        total_cost += fpinfo->local_conds_cost.per_tuple * retrieved_rows;
-        cost_qual_eval(&local_cost, join_conds, root);
-        startup_cost += local_cost.startup;
-        total_cost += local_cost.per_tuple * retrieved_rows;
-        
-cleanup:
-    dbclose(dbproc);
-    dbloginfree(login);
-        
-cleanup_before_login:
-    dbexit();
-    
-cleanup_before_init:
-    ;
     }
+    
     else
     {
-        /*
-         * We don't support join conditions in this mode (hence, no
-         * parameterized paths can be made).
-         */
-        Assert(join_conds == NIL);
-
-        /* Use rows/width estimates made by set_baserel_size_estimates. */
-        rows = baserel->rows;
-#if (PG_VERSION_NUM < 90600)
-        width = baserel->width;
-#else
-        width = baserel->reltarget->width;
-#endif /* PG_VERSION_NUM < 90600 */
+        TDS_TRACE("No more rows");
+    }
 
-        /*
-         * Back into an estimate of the number of retrieved rows.  Just in
-         * case this is nuts, clamp to at most baserel->tuples.
-         */
-        retrieved_rows = clamp_row_est(rows / fpinfo->local_conds_sel);
-        retrieved_rows = Min(retrieved_rows, baserel->tuples);
+    MemoryContextSwitchTo(old_cxt);
+    
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> finishing tdsIterateForeignScan")
+            ));
+    #endif
 
-        /*
-         * Cost as though this were a seqscan, which is pessimistic.  We
-         * effectively imagine the local_conds are being evaluated remotely,
-         * too.
-         */
-        startup_cost = 0;
-        run_cost = 0;
-        run_cost += seq_page_cost * baserel->pages;
+    return slot;
+}
 
-        startup_cost += baserel->baserestrictcost.startup;
-        cpu_per_tuple = cpu_tuple_cost + baserel->baserestrictcost.per_tuple;
-        run_cost += cpu_per_tuple * baserel->tuples;
+/* rescan foreign table */
 
-        /*
-         * Without remote estimates, we have no real way to estimate the cost
-         * of generating sorted output.  It could be free if the query plan
-         * the remote side would have chosen generates properly-sorted output
-         * anyway, but in most cases it will cost something.  Estimate a value
-         * high enough that we won't pick the sorted path when the ordering
-         * isn't locally useful, but low enough that we'll err on the side of
-         * pushing down the ORDER BY clause when it's useful to do so.
-         */
-        if (pathkeys != NIL)
-        {
-            startup_cost *= DEFAULT_FDW_SORT_MULTIPLIER;
-            run_cost *= DEFAULT_FDW_SORT_MULTIPLIER;
-        }
+void tdsReScanForeignScan(ForeignScanState *node)
+{
+    TdsFdwExecutionState *festate = (TdsFdwExecutionState *) node->fdw_state;
+    int ret_code = NO_MORE_ROWS;
 
-        total_cost = startup_cost + run_cost;
-    }
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> starting tdsReScanForeignScan")
+            ));
+    #endif
 
     /*
-     * Add some additional cost factors to account for connection overhead
-     * (fdw_startup_cost), transferring data across the network
-     * (fdw_tuple_cost per retrieved row), and local manipulation of the data
-     * (cpu_tuple_cost per retrieved row).
+     * Consume any remaining result rows.
+     * This might be necessary if the scan stopped before all
+     * rows were consumed. A query that was sent, but whose results
+     * weren't read yet, is cancelled.
      */
-    startup_cost += fpinfo->fdw_startup_cost;
-    total_cost += fpinfo->fdw_startup_cost;
-    total_cost += fpinfo->fdw_tuple_cost * retrieved_rows;
-    total_cost += cpu_tuple_cost * retrieved_rows;
+    if (festate->query_sent && !festate->first)
+        while ((ret_code = tdsNextRow(festate)) == REG_ROW)
+            ;
+    else if (festate->query_sent)
+        dbcancel(festate->dbproc);
 
-    /* Return results. */
-    *p_rows = rows;
-    *p_width = width;
-    *p_startup_cost = startup_cost;
-    *p_total_cost = total_cost;
-}
+    if (ret_code != NO_MORE_ROWS)
+        ereport(ERROR,
+            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+            errmsg("Failed to get row during query")
+            ));
+
+    /* reset the state for the next scan */
+    festate->first = 1;
+    festate->query_sent = false;
+    festate->batch_rows = 0;
+    festate->batch_next = 0;
+    festate->batch_status = REG_ROW;
     
-void tdsGetForeignRelSize(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntableid)
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> finishing tdsReScanForeignScan")
+            ));
+    #endif
+}
+
+/* cleanup objects related to scan */
+
+void tdsEndForeignScan(ForeignScanState *node)
 {
-    TdsFdwRelationInfo *fpinfo;
-    ListCell   *lc;
-    TdsFdwOptionSet option_set;
+    MemoryContext old_cxt;
+    TdsFdwExecutionState *festate = (TdsFdwExecutionState *) node->fdw_state;
+    EState *estate = node->ss.ps.state;
     
     #ifdef DEBUG
         ereport(NOTICE,
-            (errmsg("----> starting tdsGetForeignRelSize")
+            (errmsg("----> starting tdsEndForeignScan")
             ));
     #endif
     
-    tds_clear_signals();
+    old_cxt = MemoryContextSwitchTo(festate->mem_cxt);
+    
+    if (show_finished_memory_stats)
+    {
+        fprintf(stderr,"Showing memory statistics after query finished.\n");
+            
+        MemoryContextStats(estate->es_query_cxt);
+    }
     
     /*
-     * We use PgFdwRelationInfo to pass various information to subsequent
-     * functions.
+     * remember how long the remote server took, for fdw_*_cost 'auto'. Scans
+     * whose queries were all sent ahead (early_dispatch, async) are left out.
      */
-    fpinfo = (TdsFdwRelationInfo *) palloc0(sizeof(TdsFdwRelationInfo));
-    baserel->fdw_private = (void *) fpinfo;
+    if (festate->executions > 0)
+        tdsServerStatsAddScan(festate->serverid,
+            INSTR_TIME_GET_MILLISEC(festate->startup_time) / festate->executions,
+            INSTR_TIME_GET_MILLISEC(festate->fetch_time),
+            festate->row, festate->bytes);
 
-    /* Look up foreign-table catalog info. */
-    fpinfo->table = GetForeignTable(foreigntableid);
-    fpinfo->server = GetForeignServer(fpinfo->table->serverid);
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Fetched %i rows (%.0f bytes) in %.3f ms, with %.0f NULL values and %.0f values converted by input functions",
+            festate->row, festate->bytes,
+            INSTR_TIME_GET_MILLISEC(festate->fetch_time),
+            festate->null_values, festate->input_values)
+        ));
+
+    /* the shared state of a parallel scan may be detached already */
+    if (festate->nranges > 0)
+        ereport(DEBUG3,
+            (errmsg("tds_fdw: Scanned %i of %i ranges of %s",
+                festate->ranges, festate->nranges, festate->range_column)
+            ));
+
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Releasing database connection")
+        ));
     
-    tdsGetForeignTableOptionsFromCatalog(foreigntableid, &option_set);
+    tdsReleaseConnection(festate->dbproc);
     
-    fpinfo->use_remote_estimate = option_set.use_remote_estimate;
-    fpinfo->fdw_startup_cost = option_set.fdw_startup_cost;
-    fpinfo->fdw_tuple_cost = option_set.fdw_tuple_cost;
-        
-    /*
-     * Identify which baserestrictinfo clauses can be sent to the remote
-     * server and which can't.
-     */
-    classifyConditions(root, baserel, baserel->baserestrictinfo,
-                       &fpinfo->remote_conds, &fpinfo->local_conds);
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> finishing tdsEndForeignScan")
+            ));
+    #endif
 
-    /*
-     * Identify which attributes will need to be retrieved from the remote
-     * server.  These include all attrs needed for joins or final output, plus
-     * all attrs used in the local_conds.  (Note: if we end up using a
-     * parameterized scan, it's possible that some of the join clauses will be
-     * sent to the remote and thus we wouldn't really need to retrieve the
-     * columns used in them.  Doesn't seem worth detecting that case though.)
-     */
-    fpinfo->attrs_used = NULL;
-#if (PG_VERSION_NUM < 90600)
-    pull_varattnos((Node *) baserel->reltargetlist, baserel->relid,
-                   &fpinfo->attrs_used);
-#else
-    pull_varattnos((Node *) baserel->reltarget->exprs, baserel->relid,
-                   &fpinfo->attrs_used);
-#endif /* PG_VERSION_NUM < 90600 */
-    foreach(lc, fpinfo->local_conds)
-    {
-        RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+    MemoryContextSwitchTo(old_cxt);
+    MemoryContextReset(festate->mem_cxt);
+    MemoryContextReset(festate->row_cxt);
+    
+    tds_clear_signals();
+}
 
-        pull_varattnos((Node *) rinfo->clause, baserel->relid,
-                       &fpinfo->attrs_used);
-    }
+#ifdef ASYNC_API
 
-    /*
-     * Compute the selectivity and cost of the local_conds, so we don't have
-     * to do it over again for each path.  The best we can do for these
-     * conditions is to estimate selectivity on the basis of local statistics.
-     */
-    fpinfo->local_conds_sel = clauselist_selectivity(root,
-                                                     fpinfo->local_conds,
-                                                     baserel->relid,
-                                                     JOIN_INNER,
-                                                     NULL);
+bool tdsIsForeignPathAsyncCapable(ForeignPath *path)
+{
+    RelOptInfo *rel = ((Path *) path)->parent;
+    TdsFdwRelationInfo *fpinfo = (TdsFdwRelationInfo *) rel->fdw_private;
 
-    cost_qual_eval(&fpinfo->local_conds_cost, fpinfo->local_conds, root);
+    /* a parallel scan only has a query once it takes a range */
+    if (path->path.parallel_aware)
+        return false;
 
-    /*
-     * If the table or the server is configured to use remote estimates,
-     * connect to the foreign server and execute EXPLAIN to estimate the
-     * number of rows selected by the restriction clauses, as well as the
-     * average row width.  Otherwise, estimate using whatever statistics we
-     * have locally, in a way similar to ordinary tables.
-     */
-    if (fpinfo->use_remote_estimate)
+    return fpinfo->async_capable;
+}
+
+/*
+ * Under an Append node, an asynchronous scan sends its query as soon as it is
+ * asked for the first row, so the queries of all of them run on the remote
+ * servers at the same time. After that, a row is returned right away if
+ * DB-Library has the data for it already. Otherwise, the Append node goes on
+ * with the other scans until the socket of the connection is readable.
+ *
+ * Returning a row may still block, and hold up the other scans meanwhile:
+ * when DB-Library has only a part of the row (see tdsRowReady()), and when
+ * rows are filtered by local conditions, as more rows are then fetched until
+ * one passes them.
+ *
+ * Each scan has a connection of its own, so there is no other query that
+ * could be waiting for the same connection.
+ */
+
+void tdsForeignAsyncRequest(AsyncRequest *areq)
+{
+    ForeignScanState *node = (ForeignScanState *) areq->requestee;
+    TdsFdwExecutionState *festate = (TdsFdwExecutionState *) node->fdw_state;
+
+    if (!festate->query_sent)
     {
-        ereport(DEBUG3,
-            (errmsg("tds_fdw: Using remote estimate")
-        ));
-        
-        /*
-         * Get cost/size estimates with help of remote server.  Save the
-         * values in fpinfo so we don't need to do it again to generate the
-         * basic foreign path.
-         */
-        estimate_path_cost_size(root, baserel, NIL, NIL,
-                                &fpinfo->rows, &fpinfo->width,
-                                &fpinfo->startup_cost, &fpinfo->total_cost, &option_set);
+        tdsSendQuery(festate);
+        festate->time_startup = false;
+    }
 
-        /* Report estimated baserel size to planner. */
-        baserel->rows = fpinfo->rows;
-#if (PG_VERSION_NUM < 90600)
-        baserel->width = fpinfo->width;
-#else
-        baserel->reltarget->width = fpinfo->width;
-#endif /* PG_VERSION_NUM < 90600 */
+    if (festate->first || !tdsRowReady(festate))
+    {
+        ExecAsyncRequestPending(areq);
+        return;
     }
-    else
+
+    /* this applies the local conditions, and may fetch more rows for them */
+    ExecAsyncRequestDone(areq, ExecProcNode((PlanState *) node));
+}
+
+void tdsForeignAsyncConfigureWait(AsyncRequest *areq)
+{
+    ForeignScanState *node = (ForeignScanState *) areq->requestee;
+    TdsFdwExecutionState *festate = (TdsFdwExecutionState *) node->fdw_state;
+    AppendState *requestor = (AppendState *) areq->requestor;
+
+    AddWaitEventToSet(requestor->as_eventset, WL_SOCKET_READABLE,
+        dbiordesc(festate->dbproc), NULL, areq);
+}
+
+void tdsForeignAsyncNotify(AsyncRequest *areq)
+{
+    ForeignScanState *node = (ForeignScanState *) areq->requestee;
+
+    /* the first row also waits for the results of the query */
+    ExecAsyncRequestDone(areq, ExecProcNode((PlanState *) node));
+}
+
+#endif  /* ASYNC_API */
+
+#ifdef PARALLEL_API
+
+/*
+ * The ranges of partition_column are integers, so the local column it is
+ * mapped to must be of an integer type. Otherwise the table is scanned
+ * serially.
+ */
+
+static bool tdsCanSplitByRanges(Oid foreigntableid, TdsFdwOptionSet *option_set)
+{
+    Relation rel;
+    TupleDesc tupdesc;
+    Oid typid = InvalidOid;
+    int i;
+
+    if (!option_set->partition_column || option_set->query)
+        return false;
+
+    /* the planner has a lock on the table already */
+    #if PG_VERSION_NUM < 120000
+    rel = heap_open(foreigntableid, NoLock);
+    #else
+    rel = table_open(foreigntableid, NoLock);
+    #endif
+
+    tupdesc = RelationGetDescr(rel);
+
+    for (i = 0; i < tupdesc->natts; i++)
     {
-        ereport(DEBUG3,
-            (errmsg("tds_fdw: Using local estimate")
-        ));
-        
-        /*
-         * If the foreign table has never been ANALYZEd, it will have relpages
-         * and reltuples equal to zero, which most likely has nothing to do
-         * with reality.  We can't do a whole lot about that if we're not
-         * allowed to consult the remote server, but we can use a hack similar
-         * to plancat.c's treatment of empty relations: use a minimum size
-         * estimate of 10 pages, and divide by the column-datatype-based width
-         * estimate to get the corresponding number of tuples.
-         */
-        if (baserel->tuples == 0)
+        Form_pg_attribute attr = TupleDescAttr(tupdesc, i);
+        char *local_name;
+        List *options;
+        ListCell *lc;
+
+        if (attr->attisdropped)
+            continue;
+
+        local_name = NameStr(attr->attname);
+        options = GetForeignColumnOptions(foreigntableid, attr->attnum);
+
+        foreach(lc, options)
         {
-            baserel->tuples = option_set.local_tuple_estimate;
+            DefElem *def = (DefElem *) lfirst(lc);
+
+            if (strcmp(def->defname, "column_name") == 0)
+                local_name = defGetString(def);
         }
 
-        /* Estimate baserel size as best we can with local statistics. */
-        set_baserel_size_estimates(root, baserel);
+        if (strncmp(local_name, option_set->partition_column, NAMEDATALEN) == 0)
+        {
+            typid = attr->atttypid;
+            break;
+        }
+    }
+
+    #if PG_VERSION_NUM < 120000
+    heap_close(rel, NoLock);
+    #else
+    table_close(rel, NoLock);
+    #endif
+
+    if (typid == INT2OID || typid == INT4OID || typid == INT8OID)
+        return true;
 
-        /* Fill in basically-bogus cost estimates for use later. */
-        estimate_path_cost_size(root, baserel, NIL, NIL,
-                                &fpinfo->rows, &fpinfo->width,
-                                &fpinfo->startup_cost, &fpinfo->total_cost, &option_set);
-    }   
-    
-    
-#if (PG_VERSION_NUM < 90600)
-    ereport(DEBUG3,
-            (errmsg("tds_fdw: Estimated rows = %f, estimated width = %d", baserel->rows, baserel->width)
-            ));
-#else
     ereport(DEBUG3,
-            (errmsg("tds_fdw: Estimated rows = %f, estimated width = %d", baserel->rows,
-                    baserel->reltarget->width)
-            ));
-#endif /* PG_VERSION_NUM < 90600 */
+        (errmsg("tds_fdw: partition_column %s is not a local column of an integer type, the table is scanned serially",
+            option_set->partition_column)
+        ));
 
-    #ifdef DEBUG
-        ereport(NOTICE,
-            (errmsg("----> finishing tdsGetForeignRelSize")
-            ));
-    #endif  
+    return false;
 }
 
-void tdsEstimateCosts(PlannerInfo *root, RelOptInfo *baserel, Cost *startup_cost, Cost *total_cost, Oid foreigntableid)
+/*
+ * Scans of tables with partition_column can run in parallel workers. Each
+ * worker opens a connection of its own.
+ */
+
+bool tdsIsForeignScanParallelSafe(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
 {
     TdsFdwOptionSet option_set;
-    
-    #ifdef DEBUG
-        ereport(NOTICE,
-            (errmsg("----> starting tdsEstimateCosts")
-            ));
-    #endif
-    
-    tdsGetForeignTableOptionsFromCatalog(foreigntableid, &option_set);  
-    
-    *startup_cost = tdsGetStartupCost(&option_set);
-        
-    *total_cost = baserel->rows + *startup_cost;
-    
-    #ifdef DEBUG
-        ereport(NOTICE,
-            (errmsg("----> finishing tdsEstimateCosts")
-            ));
-    #endif
+
+    tdsGetForeignTableOptionsFromCatalog(rte->relid, &option_set);
+
+    return tdsCanSplitByRanges(rte->relid, &option_set);
 }
 
-void tdsGetForeignPaths(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntableid)
+Size tdsEstimateDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt)
 {
+    return sizeof(TdsFdwParallelScan);
+}
+
+/*
+ * Called in the leader of a parallel scan. The minimum and maximum of
+ * partition_column are read, and the values between them are split into a
+ * few ranges per process, so that processes which are done early can take
+ * over ranges from the others.
+ */
+
+void tdsInitializeDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt, void *coordinate)
+{
+    TdsFdwExecutionState *festate = (TdsFdwExecutionState *) node->fdw_state;
+    TdsFdwParallelScan *pscan = (TdsFdwParallelScan *) coordinate;
     TdsFdwOptionSet option_set;
-    TdsFdwRelationInfo *fpinfo = (TdsFdwRelationInfo *) baserel->fdw_private;
-    ForeignPath *path;
-    #if (PG_VERSION_NUM >= 90500)
-    List       *ppi_list;
-    #endif
-    ListCell   *lc;
-    List       *usable_pathkeys = NIL;
-    
+    StringInfoData query;
+    DBBIGINT min_value = 0;
+    DBBIGINT max_value = 0;
+    uint64 span;
+    int nranges = (pcxt->nworkers + 1) * TDS_RANGES_PER_PROCESS;
+
     #ifdef DEBUG
         ereport(NOTICE,
-            (errmsg("----> starting tdsGetForeignPaths")
+            (errmsg("----> starting tdsInitializeDSMForeignScan")
             ));
     #endif
-    
-    tdsGetForeignTableOptionsFromCatalog(foreigntableid, &option_set);
-    
-    /*
-     * Create simplest ForeignScan path node and add it to baserel.  This path
-     * corresponds to SeqScan path of regular tables (though depending on what
-     * baserestrict conditions we were able to send to remote, there might
-     * actually be an indexscan happening there).  We already did all the work
-     * to estimate cost and size of this path.
-     */
-#if PG_VERSION_NUM < 90500
-    path = create_foreignscan_path(root, baserel,
-                                   fpinfo->rows,
-                                   fpinfo->startup_cost,
-                                   fpinfo->total_cost,
-                                   NIL, /* no pathkeys */
-                                   NULL,        /* no outer rel either */
-                                   NIL);        /* no fdw_private list */   
-#elif PG_VERSION_NUM < 90600
-    path = create_foreignscan_path(root, baserel,
-                                   fpinfo->rows,
-                                   fpinfo->startup_cost,
-                                   fpinfo->total_cost,
-                                   NIL, /* no pathkeys */
-                                   NULL,        /* no outer rel either */
-                                   NULL,        /* no extra plan */
-                                   NIL);        /* no fdw_private list */
-#elif PG_VERSION_NUM < 170000
-    path = create_foreignscan_path(root, baserel, NULL,
-                                   fpinfo->rows,
-                                   fpinfo->startup_cost,
-                                   fpinfo->total_cost,
-                                   NIL, /* no pathkeys */
-                                   NULL,        /* no outer rel either */
-                                   NULL,        /* no extra plan */
-                                   NIL);        /* no fdw_private list */
-#elif PG_VERSION_NUM < 180000
-    path = create_foreignscan_path(root, baserel, NULL,
-                                   fpinfo->rows,
-                                   fpinfo->startup_cost,
-                                   fpinfo->total_cost,
-                                   NIL, /* no pathkeys */
-                                   NULL,                /* no outer rel either */
-                                   NULL,                /* no extra plan */
-                                   NIL,                 /* no fdw_restrictinfo list */
-                                   NIL);                /* no fdw_private list */
-#else
-    path = create_foreignscan_path(root, baserel, NULL,
-                                   fpinfo->rows,
-                                   0,                   /* no disabled plan nodes */
-                                   fpinfo->startup_cost,
-                                   fpinfo->total_cost,
-                                   NIL, /* no pathkeys */
-                                   NULL,                /* no outer rel either */
-                                   NULL,                /* no extra plan */
-                                   NIL,                 /* no fdw_restrictinfo list */
-                                   NIL);                /* no fdw_private list */
-#endif /* PG_VERSION_NUM < 90500 */
-    
-    add_path(baserel, (Path *) path);
+
+    tdsGetForeignTableOptionsFromCatalog(RelationGetRelid(node->ss.ss_currentRelation), &option_set);
+
+    /* for an empty table, both stay 0, and there is a single range */
+    initStringInfo(&query);
+    appendStringInfo(&query, "SELECT MIN(%s) FROM ", festate->range_column);
+    tdsAppendRemoteRelation(&query, &option_set);
+    tdsQueryValue(query.data, festate->dbproc, BIGINTBIND, sizeof(DBBIGINT), (BYTE *) &min_value);
+
+    resetStringInfo(&query);
+    appendStringInfo(&query, "SELECT MAX(%s) FROM ", festate->range_column);
+    tdsAppendRemoteRelation(&query, &option_set);
+    tdsQueryValue(query.data, festate->dbproc, BIGINTBIND, sizeof(DBBIGINT), (BYTE *) &max_value);
+
+    if (max_value < min_value)
+        max_value = min_value;
 
     /*
-     * Determine whether we can potentially push query pathkeys to the remote
-     * side, avoiding a local sort.
+     * There are span + 1 values, which may not fit into an int64. Each range
+     * gets the same number of them, rounded up, and there are only as many
+     * ranges as it takes to reach the maximum. So no bound is beyond it.
      */
-    foreach(lc, root->query_pathkeys)
+    span = (uint64) max_value - (uint64) min_value;
+
+    SpinLockInit(&pscan->mutex);
+    pscan->next_range = 0;
+    pscan->range_start = min_value;
+    pscan->range_step = span / nranges + 1;
+    pscan->nranges = (int) (span / pscan->range_step) + 1;
+
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Split %s from " INT64_FORMAT " to " INT64_FORMAT " into %i ranges for %i workers",
+            festate->range_column, (int64) min_value, (int64) max_value,
+            pscan->nranges, pcxt->nworkers)
+        ));
+
+    festate->pscan = pscan;
+
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> finishing tdsInitializeDSMForeignScan")
+            ));
+    #endif
+}
+
+#if (PG_VERSION_NUM >= 100000)
+/* the ranges stay the same, they only have to be scanned again */
+
+void tdsReInitializeDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt, void *coordinate)
+{
+    TdsFdwParallelScan *pscan = (TdsFdwParallelScan *) coordinate;
+
+    pscan->next_range = 0;
+}
+#endif
+
+void tdsInitializeWorkerForeignScan(ForeignScanState *node, shm_toc *toc, void *coordinate)
+{
+    TdsFdwExecutionState *festate = (TdsFdwExecutionState *) node->fdw_state;
+
+    festate->pscan = (TdsFdwParallelScan *) coordinate;
+}
+
+#endif  /* PARALLEL_API */
+
+/*
+ * Return the given pathkeys if all of them can be sent to the remote server,
+ * NIL otherwise.
+ */
+static List *
+tdsGetUsablePathkeys(PlannerInfo *root, RelOptInfo *baserel, List *pathkeys)
+{
+    List       *usable_pathkeys = NIL;
+    ListCell   *lc;
+
+    foreach(lc, pathkeys)
     {
         PathKey    *pathkey = (PathKey *) lfirst(lc);
         EquivalenceClass *pathkey_ec = pathkey->pk_eclass;
@@ -2698,315 +3577,1632 @@ void tdsGetForeignPaths(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntable
              * down all of the query pathkeys, forget it.
              */
             list_free(usable_pathkeys);
-            usable_pathkeys = NIL;
-            break;
+            return NIL;
         }
     }
 
-    /* Create a path with useful pathkeys, if we found one. */
-    if (usable_pathkeys != NULL)
-    {
-        double      rows;
-        int         width;
-        Cost        startup_cost;
-        Cost        total_cost;
+    return usable_pathkeys;
+}
 
-        estimate_path_cost_size(root, baserel, NIL, usable_pathkeys,
-                                &rows, &width, &startup_cost, &total_cost, &option_set);
+static void
+tdsRememberRemoteEstimate(TdsFdwRelationInfo *fpinfo, const char *query, double rows)
+{
+    TdsFdwRemoteEstimate *estimate;
 
-        add_path(baserel, (Path *)
-#if PG_VERSION_NUM < 90500
-                 create_foreignscan_path(root, baserel,
-                                         rows,
-                                         startup_cost,
-                                         total_cost,
-                                         usable_pathkeys,
-                                         NULL,
-                                         NIL));
-#elif PG_VERSION_NUM < 90600
-                 create_foreignscan_path(root, baserel,
-                                         rows,
-                                         startup_cost,
-                                         total_cost,
-                                         usable_pathkeys,
-                                         NULL,
-                                         NULL,
-                                         NIL));
-#elif PG_VERSION_NUM < 170000
-                 create_foreignscan_path(root, baserel,
-                                         NULL,
-                                         rows,
-                                         startup_cost,
-                                         total_cost,
-                                         usable_pathkeys,
-                                         NULL,
-                                         NULL,
-                                         NIL));
-#elif PG_VERSION_NUM < 180000
-                 create_foreignscan_path(root, baserel,
-                                         NULL,
-                                         rows,
-                                         startup_cost,
-                                         total_cost,
-                                         usable_pathkeys,
-                                         NULL,
-                                         NULL,
-                                         NIL,
-                                         NIL));
-#else
-                 create_foreignscan_path(root, baserel,
-                                         NULL,
-                                         rows,
-                                         0,
-                                         startup_cost,
-                                         total_cost,
-                                         usable_pathkeys,
-                                         NULL,
-                                         NULL,
-                                         NIL,
-                                         NIL));
-#endif /* PG_VERSION_NUM < 90500 */
+    estimate = (TdsFdwRemoteEstimate *) palloc(sizeof(TdsFdwRemoteEstimate));
+    estimate->query = pstrdup(query);
+    estimate->rows = rows;
+    fpinfo->remote_estimates = lappend(fpinfo->remote_estimates, estimate);
+}
+
+static bool
+tdsHaveRemoteEstimate(TdsFdwRelationInfo *fpinfo, const char *query)
+{
+    ListCell   *lc;
+
+    foreach(lc, fpinfo->remote_estimates)
+    {
+        TdsFdwRemoteEstimate *estimate = (TdsFdwRemoteEstimate *) lfirst(lc);
+
+        if (strcmp(estimate->query, query) == 0)
+            return true;
     }
-    
-    /* Don't worry about join pushdowns unless this is PostgreSQL 9.5+ */
-    #if (PG_VERSION_NUM >= 90500)
 
-    /*
-     * If we're not using remote estimates, stop here.  We have no way to
-     * estimate whether any join clauses would be worth sending across, so
-     * don't bother building parameterized paths.
-     */
-    if (!fpinfo->use_remote_estimate)
-        return;
+    return false;
+}
 
-    /*
-     * Thumb through all join clauses for the rel to identify which outer
-     * relations could supply one or more safe-to-send-to-remote join clauses.
-     * We'll build a parameterized path for each such outer relation.
-     *
-     * It's convenient to manage this by representing each candidate outer
-     * relation by the ParamPathInfo node for it.  We can then use the
-     * ppi_clauses list in the ParamPathInfo node directly as a list of the
-     * interesting join clauses for that rel.  This takes care of the
-     * possibility that there are multiple safe join clauses for such a rel,
-     * and also ensures that we account for unsafe join clauses that we'll
-     * still have to enforce locally (since the parameterized-path machinery
-     * insists that we handle all movable clauses).
-     */
-    ppi_list = NIL;
-    foreach(lc, baserel->joininfo)
+/*
+ * Get the SHOWPLAN_ALL estimate of option_set->query, which is not known
+ * yet, and return it.
+ *
+ * The same round trips also estimate the queries of the paths the planner
+ * costs for this relation in tdsGetForeignPaths(): the basic scan, and the
+ * scan sorted by the query's pathkeys. Their estimates are remembered in
+ * fpinfo and in the estimate cache, so costing those paths won't go to the
+ * remote server again.
+ */
+static double
+tdsGetCandidateRowCounts(PlannerInfo *root, RelOptInfo *baserel,
+    TdsFdwOptionSet *option_set, List *remote_join_conds, DBPROCESS *dbproc)
+{
+    TdsFdwRelationInfo *fpinfo = (TdsFdwRelationInfo *) baserel->fdw_private;
+    char       *query = option_set->query;
+    List       *candidates = NIL;
+    List       *usable_pathkeys;
+    List       *retrieved_attrs;
+    char      **queries;
+    double     *rows;
+    double      result;
+    int         nqueries;
+    int         i;
+    ListCell   *lc;
+
+    candidates = lappend(candidates, query);
+
+    usable_pathkeys = tdsGetUsablePathkeys(root, baserel, root->query_pathkeys);
+
+    for (i = 0; i < 2; i++)
     {
-        RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
-        Relids      required_outer;
-        ParamPathInfo *param_info;
+        List       *candidate_pathkeys = (i == 0) ? NIL : usable_pathkeys;
+        char       *candidate;
+        double      cached_rows;
+        bool        duplicate = false;
 
-        /* Check if clause can be moved to this rel */
-        if (!join_clause_is_movable_to(rinfo, baserel))
-            continue;
+        if (i == 1 && usable_pathkeys == NIL)
+            break;
 
-        /* See if it is safe to send to remote */
-        if (!is_foreign_expr(root, baserel, rinfo->clause))
-            continue;
+        /* tdsBuildForeignQuery() leaves the query in option_set */
+        tdsBuildForeignQuery(root, baserel, option_set,
+            fpinfo->attrs_used, &retrieved_attrs,
+            fpinfo->remote_conds, remote_join_conds, candidate_pathkeys);
+        candidate = option_set->query;
 
-        /* Calculate required outer rels for the resulting path */
-        required_outer = bms_union(rinfo->clause_relids,
-                                   baserel->lateral_relids);
-        /* We do not want the foreign rel itself listed in required_outer */
-        required_outer = bms_del_member(required_outer, baserel->relid);
+        foreach(lc, candidates)
+        {
+            if (strcmp((char *) lfirst(lc), candidate) == 0)
+                duplicate = true;
+        }
 
-        /*
-         * required_outer probably can't be empty here, but if it were, we
-         * couldn't make a parameterized path.
-         */
-        if (bms_is_empty(required_outer))
+        if (duplicate || tdsHaveRemoteEstimate(fpinfo, candidate))
             continue;
 
-        /* Get the ParamPathInfo */
-        param_info = get_baserel_parampathinfo(root, baserel,
-                                               required_outer);
-        Assert(param_info != NULL);
-
-        /*
-         * Add it to list unless we already have it.  Testing pointer equality
-         * is OK since get_baserel_parampathinfo won't make duplicates.
-         */
-        ppi_list = list_append_unique_ptr(ppi_list, param_info);
+        if (tdsEstimateCacheLookup(fpinfo->table->serverid, candidate, false, &cached_rows))
+            tdsRememberRemoteEstimate(fpinfo, candidate, cached_rows);
+        else
+            candidates = lappend(candidates, candidate);
     }
 
-    /*
-     * The above scan examined only "generic" join clauses, not those that
-     * were absorbed into EquivalenceClauses.  See if we can make anything out
-     * of EquivalenceClauses.
-     */
-    if (baserel->has_eclass_joins)
+    option_set->query = query;
+
+    nqueries = list_length(candidates);
+    queries = (char **) palloc(nqueries * sizeof(char *));
+    rows = (double *) palloc(nqueries * sizeof(double));
+
+    i = 0;
+    foreach(lc, candidates)
+        queries[i++] = (char *) lfirst(lc);
+
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Getting remote estimates for %i queries", nqueries)
+        ));
+
+    tdsGetRowCountsShowPlanAll(dbproc, nqueries, queries, rows);
+
+    for (i = 0; i < nqueries; i++)
+    {
+        tdsEstimateCacheStore(fpinfo->table->serverid, queries[i], rows[i]);
+        tdsRememberRemoteEstimate(fpinfo, queries[i], rows[i]);
+    }
+
+    result = rows[0];
+
+    pfree(queries);
+    pfree(rows);
+    list_free(candidates);
+
+    return result;
+}
+
+/*
+ * Set the costs of scanning a relation. When fdw_startup_cost or
+ * fdw_tuple_cost is 'auto', it is derived from the time past scans of the
+ * server took. That time includes the network, so the network cost from
+ * the measured latency isn't added on top of it.
+ */
+static void
+tdsSetScanCosts(TdsFdwRelationInfo *fpinfo, TdsFdwOptionSet *option_set, int width)
+{
+    Oid serverid = fpinfo->table->serverid;
+    double startup_ms = 0;
+    double ms_per_byte = -1;
+    bool have_scans = false;
+
+    fpinfo->fdw_startup_cost = option_set->fdw_startup_cost;
+    fpinfo->fdw_tuple_cost = option_set->fdw_tuple_cost;
+    fpinfo->network_startup_cost = tdsGetStartupCost(serverid, option_set);
+    fpinfo->network_tuple_cost = tdsGetTupleNetworkCost(serverid, width);
+
+    if (option_set->fdw_startup_cost == TDS_AUTO_COST ||
+        option_set->fdw_tuple_cost == TDS_AUTO_COST)
+        have_scans = tdsServerStatsGetScanTimes(serverid, &startup_ms, &ms_per_byte);
+
+    if (option_set->fdw_startup_cost == TDS_AUTO_COST)
+    {
+        if (have_scans)
+        {
+            fpinfo->fdw_startup_cost = startup_ms * TDS_COST_PER_MS;
+            fpinfo->network_startup_cost = 0;
+        }
+        else
+            fpinfo->fdw_startup_cost = TDS_AUTO_STARTUP_COST_DEFAULT;
+    }
+
+    if (option_set->fdw_tuple_cost == TDS_AUTO_COST)
+    {
+        if (have_scans && ms_per_byte >= 0)
+        {
+            fpinfo->fdw_tuple_cost = ms_per_byte * Max(width, 1) * TDS_COST_PER_MS;
+            fpinfo->network_tuple_cost = 0;
+        }
+        else
+            fpinfo->fdw_tuple_cost = TDS_AUTO_TUPLE_COST_DEFAULT;
+    }
+
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: fdw_startup_cost is %f and fdw_tuple_cost is %f, network costs are %f and %f",
+            fpinfo->fdw_startup_cost, fpinfo->fdw_tuple_cost,
+            fpinfo->network_startup_cost, fpinfo->network_tuple_cost)
+        ));
+}
+
+/*
+ * Get the remote estimate of option_set->query, which is not known yet, and
+ * return it.
+ *
+ * If estimate_timeout is set, the estimate runs in a subtransaction. When the
+ * server doesn't answer within that many seconds, or an 'execute' estimate
+ * goes on fetching rows for longer than that, the remote query is cancelled
+ * and the subtransaction is rolled back. The connection is closed, as it may
+ * be in the middle of the query, or have SHOWPLAN_ALL on. The estimate then
+ * falls back to an expired entry of the estimate cache, or to
+ * local_tuple_estimate, so a slow server can't hold up planning.
+ */
+static double
+tdsGetRemoteEstimate(PlannerInfo *root, RelOptInfo *baserel,
+    TdsFdwOptionSet *option_set, List *remote_join_conds)
+{
+    TdsFdwRelationInfo *fpinfo = (TdsFdwRelationInfo *) baserel->fdw_private;
+    MemoryContext old_cxt = CurrentMemoryContext;
+    ResourceOwner old_owner = CurrentResourceOwner;
+    char *query = option_set->query;
+    DBPROCESS *dbproc;
+    volatile double rows = 0;
+
+    dbproc = tdsGetConnection(fpinfo->table->serverid, option_set);
+
+    if (option_set->estimate_timeout > 0)
+    {
+        BeginInternalSubTransaction(NULL);
+        MemoryContextSwitchTo(old_cxt);
+
+        INSTR_TIME_SET_CURRENT(estimate_start);
+        estimate_timeout = option_set->estimate_timeout;
+        dbsettime(option_set->estimate_timeout);
+        estimate_timeout_active = true;
+        estimate_timed_out = false;
+    }
+
+    PG_TRY();
     {
         /*
-         * We repeatedly scan the eclass list looking for column references
-         * (or expressions) belonging to the foreign rel.  Each time we find
-         * one, we generate a list of equivalence joinclauses for it, and then
-         * see if any are safe to send to the remote.  Repeat till there are
-         * no more candidate EC members.
+         * SHOWPLAN_ALL can estimate several queries in one batch, so also
+         * ask about the other paths the planner is going to cost.
          */
-        ec_member_foreign_arg arg;
+        if (strcmp(option_set->row_estimate_method, "showplan_all") == 0)
+            rows = tdsGetCandidateRowCounts(root, baserel, option_set, remote_join_conds, dbproc);
 
-        arg.already_used = NIL;
-        for (;;)
+        else
         {
-            List       *clauses;
+            rows = tdsGetRowCount(option_set, dbproc, fpinfo->remote_conds_sel);
 
-            /* Make clauses, skipping any that join to lateral_referencers */
-            arg.current = NULL;
-            clauses = generate_implied_equalities_for_column(root,
-                                                             baserel,
-                                                   ec_member_matches_foreign,
-                                                             (void *) &arg,
-                                               baserel->lateral_referencers);
+            tdsEstimateCacheStore(fpinfo->table->serverid, option_set->query, rows);
+            tdsRememberRemoteEstimate(fpinfo, option_set->query, rows);
+        }
 
-            /* Done if there are no more expressions in the foreign rel */
-            if (arg.current == NULL)
+        if (option_set->estimate_timeout > 0)
+        {
+            dbsettime(0);
+            estimate_timeout_active = false;
+
+            ReleaseCurrentSubTransaction();
+            MemoryContextSwitchTo(old_cxt);
+            CurrentResourceOwner = old_owner;
+        }
+    }
+    PG_CATCH();
+    {
+        ErrorData *edata;
+        bool timed_out = estimate_timed_out;
+        double cached_rows;
+
+        /* without a subtransaction, the connection is closed at the end of the transaction */
+        if (option_set->estimate_timeout <= 0)
+            PG_RE_THROW();
+
+        dbsettime(0);
+        estimate_timeout_active = false;
+        estimate_timed_out = false;
+
+        MemoryContextSwitchTo(old_cxt);
+        edata = CopyErrorData();
+        FlushErrorState();
+
+        RollbackAndReleaseCurrentSubTransaction();
+        MemoryContextSwitchTo(old_cxt);
+        CurrentResourceOwner = old_owner;
+
+        tdsDiscardConnection(dbproc);
+
+        if (!timed_out)
+            ReThrowError(edata);
+
+        FreeErrorData(edata);
+
+        option_set->query = query;
+
+        if (tdsEstimateCacheLookup(fpinfo->table->serverid, query, true, &cached_rows))
+        {
+            rows = cached_rows;
+
+            ereport(WARNING,
+                (errmsg("Remote estimate timed out after %i seconds, using an expired estimate of %.0f rows",
+                    option_set->estimate_timeout, rows)
+                ));
+        }
+        else
+        {
+            rows = clamp_row_est(option_set->local_tuple_estimate * fpinfo->remote_conds_sel);
+
+            ereport(WARNING,
+                (errmsg("Remote estimate timed out after %i seconds, using local_tuple_estimate",
+                    option_set->estimate_timeout)
+                ));
+        }
+
+        /* don't ask again while planning this relation */
+        tdsRememberRemoteEstimate(fpinfo, query, rows);
+
+        return rows;
+    }
+    PG_END_TRY();
+
+    tdsReleaseConnection(dbproc);
+
+    return rows;
+}
+
+/*
+ * estimate_path_cost_size
+ *      Get cost and size estimates for a foreign scan
+ *
+ * We assume that all the baserestrictinfo clauses will be applied, plus
+ * any join clauses listed in join_conds.
+ */
+static void
+estimate_path_cost_size(PlannerInfo *root,
+                        RelOptInfo *baserel,
+                        List *join_conds,
+                        List *pathkeys,
+                        double *p_rows, int *p_width,
+                        Cost *p_startup_cost, Cost *p_total_cost, TdsFdwOptionSet *option_set)
+{
+    TdsFdwRelationInfo *fpinfo = (TdsFdwRelationInfo *) baserel->fdw_private;
+    double      rows = 0.0;
+    double      retrieved_rows = 0.0;
+    int         width = 0;
+    Cost        startup_cost = 0;
+    Cost        total_cost = 0;
+    Cost        run_cost;
+    Cost        cpu_per_tuple;
+
+    /*
+     * If the table or the server is configured to use remote estimates,
+     * connect to the foreign server and execute EXPLAIN to estimate the
+     * number of rows selected by the restriction+join clauses.  Otherwise,
+     * estimate rows using whatever statistics we have locally, in a way
+     * similar to ordinary tables.
+     */
+    if (fpinfo->use_remote_estimate)
+    {
+        Selectivity local_sel;
+        QualCost    local_cost;
+        List       *remote_join_conds;
+        List       *local_join_conds;
+        List       *usable_pathkeys;
+        ListCell   *lc;
+        List *retrieved_attrs;
+        
+        /*
+         * join_conds might contain both clauses that are safe to send across,
+         * and clauses that aren't.
+         */
+        classifyConditions(root, baserel, baserel->baserestrictinfo,
+                           &remote_join_conds, &local_join_conds);
+                           
+        /*
+         * Determine whether we can potentially push query pathkeys to the remote
+         * side, avoiding a local sort.
+         */
+        usable_pathkeys = tdsGetUsablePathkeys(root, baserel, pathkeys);
+        
+        tdsBuildForeignQuery(root, baserel, option_set, 
+            fpinfo->attrs_used, &retrieved_attrs,
+            fpinfo->remote_conds, remote_join_conds, usable_pathkeys);
+
+        /*
+         * Get the remote estimate. The planner often costs several paths that
+         * end up with the same remote query (e.g. when no join clause can be
+         * sent across), so ask the remote server only once per query text.
+         */
+        rows = -1;
+        foreach(lc, fpinfo->remote_estimates)
+        {
+            TdsFdwRemoteEstimate *estimate = (TdsFdwRemoteEstimate *) lfirst(lc);
+
+            if (strcmp(estimate->query, option_set->query) == 0)
             {
-                Assert(clauses == NIL);
+                ereport(DEBUG3,
+                    (errmsg("tds_fdw: Reusing remote estimate of %f rows", estimate->rows)
+                    ));
+
+                rows = estimate->rows;
                 break;
             }
+        }
 
-            /* Scan the extracted join clauses */
-            foreach(lc, clauses)
+        if (rows < 0)
+        {
+            /* other plans, in this or another backend, may have asked already */
+            if (tdsEstimateCacheLookup(fpinfo->table->serverid, option_set->query, false, &rows))
+                tdsRememberRemoteEstimate(fpinfo, option_set->query, rows);
+
+            else
+                rows = tdsGetRemoteEstimate(root, baserel, option_set, remote_join_conds);
+        }
+
+        retrieved_rows = rows;
+        
+        width = fpinfo->fdw_tuple_cost;
+        startup_cost = fpinfo->fdw_startup_cost;
+        total_cost = 0;
+
+        /* Factor in the selectivity of the locally-checked quals */
+        local_sel = clauselist_selectivity(root,
+                                           join_conds,
+                                           baserel->relid,
+                                           JOIN_INNER,
+                                           NULL);
+        local_sel *= fpinfo->local_conds_sel;
+
+        rows = clamp_row_est(rows * local_sel);
+
+        /* Add in the eval cost of the locally-checked quals */
+        startup_cost += fpinfo->local_conds_cost.startup;
+        total_cost += fpinfo->local_conds_cost.per_tuple * retrieved_rows;
+        cost_qual_eval(&local_cost, join_conds, root);
+        startup_cost += local_cost.startup;
+        total_cost += local_cost.per_tuple * retrieved_rows;
+    }
+    else
+    {
+        /*
+         * We don't support join conditions in this mode (hence, no
+         * parameterized paths can be made).
+         */
+        Assert(join_conds == NIL);
+
+        /* Use rows/width estimates made by set_baserel_size_estimates. */
+        rows = baserel->rows;
+#if (PG_VERSION_NUM < 90600)
+        width = baserel->width;
+#else
+        width = baserel->reltarget->width;
+#endif /* PG_VERSION_NUM < 90600 */
+
+        /*
+         * Back into an estimate of the number of retrieved rows.  Just in
+         * case this is nuts, clamp to at most baserel->tuples.
+         */
+        retrieved_rows = clamp_row_est(rows / fpinfo->local_conds_sel);
+        retrieved_rows = Min(retrieved_rows, baserel->tuples);
+
+        /*
+         * Cost as though this were a seqscan, which is pessimistic.  We
+         * effectively imagine the local_conds are being evaluated remotely,
+         * too.
+         */
+        startup_cost = 0;
+        run_cost = 0;
+        run_cost += seq_page_cost * baserel->pages;
+
+        startup_cost += baserel->baserestrictcost.startup;
+        cpu_per_tuple = cpu_tuple_cost + baserel->baserestrictcost.per_tuple;
+        run_cost += cpu_per_tuple * baserel->tuples;
+
+        /*
+         * Without remote estimates, we have no real way to estimate the cost
+         * of generating sorted output.  It could be free if the query plan
+         * the remote side would have chosen generates properly-sorted output
+         * anyway, but in most cases it will cost something.  Estimate a value
+         * high enough that we won't pick the sorted path when the ordering
+         * isn't locally useful, but low enough that we'll err on the side of
+         * pushing down the ORDER BY clause when it's useful to do so.
+         */
+        if (pathkeys != NIL)
+        {
+            startup_cost *= DEFAULT_FDW_SORT_MULTIPLIER;
+            run_cost *= DEFAULT_FDW_SORT_MULTIPLIER;
+        }
+
+        total_cost = startup_cost + run_cost;
+    }
+
+    /*
+     * Add some additional cost factors to account for connection overhead
+     * (fdw_startup_cost), transferring data across the network
+     * (fdw_tuple_cost per retrieved row), and local manipulation of the data
+     * (cpu_tuple_cost per retrieved row). The measured latency of the server
+     * adds a round trip, and the time to send the rows.
+     */
+    startup_cost += fpinfo->fdw_startup_cost + fpinfo->network_startup_cost;
+    total_cost += fpinfo->fdw_startup_cost + fpinfo->network_startup_cost;
+    total_cost += (fpinfo->fdw_tuple_cost + fpinfo->network_tuple_cost) * retrieved_rows;
+    total_cost += cpu_tuple_cost * retrieved_rows;
+
+    /* Return results. */
+    *p_rows = rows;
+    *p_width = width;
+    *p_startup_cost = startup_cost;
+    *p_total_cost = total_cost;
+}
+    
+void tdsGetForeignRelSize(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntableid)
+{
+    TdsFdwRelationInfo *fpinfo;
+    ListCell   *lc;
+    TdsFdwOptionSet option_set;
+    
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> starting tdsGetForeignRelSize")
+            ));
+    #endif
+    
+    tds_clear_signals();
+    
+    /*
+     * We use PgFdwRelationInfo to pass various information to subsequent
+     * functions.
+     */
+    fpinfo = (TdsFdwRelationInfo *) palloc0(sizeof(TdsFdwRelationInfo));
+    baserel->fdw_private = (void *) fpinfo;
+
+    /* Look up foreign-table catalog info. */
+    fpinfo->table = GetForeignTable(foreigntableid);
+    fpinfo->server = GetForeignServer(fpinfo->table->serverid);
+    
+    tdsGetForeignTableOptionsFromCatalog(foreigntableid, &option_set);
+    
+    fpinfo->use_remote_estimate = option_set.use_remote_estimate;
+    fpinfo->async_capable = option_set.async_capable;
+#if (PG_VERSION_NUM < 90600)
+    tdsSetScanCosts(fpinfo, &option_set, baserel->width);
+#else
+    tdsSetScanCosts(fpinfo, &option_set, baserel->reltarget->width);
+#endif /* PG_VERSION_NUM < 90600 */
+        
+    /*
+     * Identify which baserestrictinfo clauses can be sent to the remote
+     * server and which can't.
+     */
+    classifyConditions(root, baserel, baserel->baserestrictinfo,
+                       &fpinfo->remote_conds, &fpinfo->local_conds);
+
+    /*
+     * Identify which attributes will need to be retrieved from the remote
+     * server.  These include all attrs needed for joins or final output, plus
+     * all attrs used in the local_conds.  (Note: if we end up using a
+     * parameterized scan, it's possible that some of the join clauses will be
+     * sent to the remote and thus we wouldn't really need to retrieve the
+     * columns used in them.  Doesn't seem worth detecting that case though.)
+     */
+    fpinfo->attrs_used = NULL;
+#if (PG_VERSION_NUM < 90600)
+    pull_varattnos((Node *) baserel->reltargetlist, baserel->relid,
+                   &fpinfo->attrs_used);
+#else
+    pull_varattnos((Node *) baserel->reltarget->exprs, baserel->relid,
+                   &fpinfo->attrs_used);
+#endif /* PG_VERSION_NUM < 90600 */
+    foreach(lc, fpinfo->local_conds)
+    {
+        RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+
+        pull_varattnos((Node *) rinfo->clause, baserel->relid,
+                       &fpinfo->attrs_used);
+    }
+
+    /*
+     * Compute the selectivity and cost of the local_conds, so we don't have
+     * to do it over again for each path.  The best we can do for these
+     * conditions is to estimate selectivity on the basis of local statistics.
+     */
+    fpinfo->local_conds_sel = clauselist_selectivity(root,
+                                                     fpinfo->local_conds,
+                                                     baserel->relid,
+                                                     JOIN_INNER,
+                                                     NULL);
+
+    cost_qual_eval(&fpinfo->local_conds_cost, fpinfo->local_conds, root);
+
+    fpinfo->remote_conds_sel = clauselist_selectivity(root,
+                                                      fpinfo->remote_conds,
+                                                      baserel->relid,
+                                                      JOIN_INNER,
+                                                      NULL);
+
+    /*
+     * If the table or the server is configured to use remote estimates,
+     * connect to the foreign server and execute EXPLAIN to estimate the
+     * number of rows selected by the restriction clauses, as well as the
+     * average row width.  Otherwise, estimate using whatever statistics we
+     * have locally, in a way similar to ordinary tables.
+     */
+    if (fpinfo->use_remote_estimate)
+    {
+        ereport(DEBUG3,
+            (errmsg("tds_fdw: Using remote estimate")
+        ));
+        
+        /*
+         * Get cost/size estimates with help of remote server.  Save the
+         * values in fpinfo so we don't need to do it again to generate the
+         * basic foreign path.
+         */
+        estimate_path_cost_size(root, baserel, NIL, NIL,
+                                &fpinfo->rows, &fpinfo->width,
+                                &fpinfo->startup_cost, &fpinfo->total_cost, &option_set);
+
+        /* Report estimated baserel size to planner. */
+        baserel->rows = fpinfo->rows;
+#if (PG_VERSION_NUM < 90600)
+        baserel->width = fpinfo->width;
+#else
+        baserel->reltarget->width = fpinfo->width;
+#endif /* PG_VERSION_NUM < 90600 */
+    }
+    else
+    {
+        ereport(DEBUG3,
+            (errmsg("tds_fdw: Using local estimate")
+        ));
+        
+        /*
+         * If the foreign table has never been ANALYZEd, it will have relpages
+         * and reltuples equal to zero, which most likely has nothing to do
+         * with reality.  We can't do a whole lot about that if we're not
+         * allowed to consult the remote server, but we can use a hack similar
+         * to plancat.c's treatment of empty relations: use a minimum size
+         * estimate of 10 pages, and divide by the column-datatype-based width
+         * estimate to get the corresponding number of tuples.
+         */
+        if (baserel->tuples == 0)
+        {
+            baserel->tuples = option_set.local_tuple_estimate;
+        }
+
+        /* Estimate baserel size as best we can with local statistics. */
+        set_baserel_size_estimates(root, baserel);
+
+        /* Fill in basically-bogus cost estimates for use later. */
+        estimate_path_cost_size(root, baserel, NIL, NIL,
+                                &fpinfo->rows, &fpinfo->width,
+                                &fpinfo->startup_cost, &fpinfo->total_cost, &option_set);
+    }   
+    
+    
+#if (PG_VERSION_NUM < 90600)
+    ereport(DEBUG3,
+            (errmsg("tds_fdw: Estimated rows = %f, estimated width = %d", baserel->rows, baserel->width)
+            ));
+#else
+    ereport(DEBUG3,
+            (errmsg("tds_fdw: Estimated rows = %f, estimated width = %d", baserel->rows,
+                    baserel->reltarget->width)
+            ));
+#endif /* PG_VERSION_NUM < 90600 */
+
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> finishing tdsGetForeignRelSize")
+            ));
+    #endif  
+}
+
+void tdsEstimateCosts(PlannerInfo *root, RelOptInfo *baserel, Cost *startup_cost, Cost *total_cost, Oid foreigntableid)
+{
+    TdsFdwOptionSet option_set;
+    
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> starting tdsEstimateCosts")
+            ));
+    #endif
+    
+    tdsGetForeignTableOptionsFromCatalog(foreigntableid, &option_set);  
+    
+    *startup_cost = tdsGetStartupCost(GetForeignTable(foreigntableid)->serverid, &option_set);
+        
+    *total_cost = baserel->rows + *startup_cost;
+    
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> finishing tdsEstimateCosts")
+            ));
+    #endif
+}
+
+void tdsGetForeignPaths(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntableid)
+{
+    TdsFdwOptionSet option_set;
+    TdsFdwRelationInfo *fpinfo = (TdsFdwRelationInfo *) baserel->fdw_private;
+    ForeignPath *path;
+    #if (PG_VERSION_NUM >= 90500)
+    List       *ppi_list;
+    #endif
+    ListCell   *lc;
+    List       *usable_pathkeys = NIL;
+    
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> starting tdsGetForeignPaths")
+            ));
+    #endif
+    
+    tdsGetForeignTableOptionsFromCatalog(foreigntableid, &option_set);
+    
+    /*
+     * Create simplest ForeignScan path node and add it to baserel.  This path
+     * corresponds to SeqScan path of regular tables (though depending on what
+     * baserestrict conditions we were able to send to remote, there might
+     * actually be an indexscan happening there).  We already did all the work
+     * to estimate cost and size of this path.
+     */
+#if PG_VERSION_NUM < 90500
+    path = create_foreignscan_path(root, baserel,
+                                   fpinfo->rows,
+                                   fpinfo->startup_cost,
+                                   fpinfo->total_cost,
+                                   NIL, /* no pathkeys */
+                                   NULL,        /* no outer rel either */
+                                   NIL);        /* no fdw_private list */   
+#elif PG_VERSION_NUM < 90600
+    path = create_foreignscan_path(root, baserel,
+                                   fpinfo->rows,
+                                   fpinfo->startup_cost,
+                                   fpinfo->total_cost,
+                                   NIL, /* no pathkeys */
+                                   NULL,        /* no outer rel either */
+                                   NULL,        /* no extra plan */
+                                   NIL);        /* no fdw_private list */
+#elif PG_VERSION_NUM < 170000
+    path = create_foreignscan_path(root, baserel, NULL,
+                                   fpinfo->rows,
+                                   fpinfo->startup_cost,
+                                   fpinfo->total_cost,
+                                   NIL, /* no pathkeys */
+                                   NULL,        /* no outer rel either */
+                                   NULL,        /* no extra plan */
+                                   NIL);        /* no fdw_private list */
+#elif PG_VERSION_NUM < 180000
+    path = create_foreignscan_path(root, baserel, NULL,
+                                   fpinfo->rows,
+                                   fpinfo->startup_cost,
+                                   fpinfo->total_cost,
+                                   NIL, /* no pathkeys */
+                                   NULL,                /* no outer rel either */
+                                   NULL,                /* no extra plan */
+                                   NIL,                 /* no fdw_restrictinfo list */
+                                   NIL);                /* no fdw_private list */
+#else
+    path = create_foreignscan_path(root, baserel, NULL,
+                                   fpinfo->rows,
+                                   0,                   /* no disabled plan nodes */
+                                   fpinfo->startup_cost,
+                                   fpinfo->total_cost,
+                                   NIL, /* no pathkeys */
+                                   NULL,                /* no outer rel either */
+                                   NULL,                /* no extra plan */
+                                   NIL,                 /* no fdw_restrictinfo list */
+                                   NIL);                /* no fdw_private list */
+#endif /* PG_VERSION_NUM < 90500 */
+    
+    add_path(baserel, (Path *) path);
+
+    /*
+     * Determine whether we can potentially push query pathkeys to the remote
+     * side, avoiding a local sort.
+     */
+    usable_pathkeys = tdsGetUsablePathkeys(root, baserel, root->query_pathkeys);
+
+    /* Create a path with useful pathkeys, if we found one. */
+    if (usable_pathkeys != NULL)
+    {
+        double      rows;
+        int         width;
+        Cost        startup_cost;
+        Cost        total_cost;
+
+        estimate_path_cost_size(root, baserel, NIL, usable_pathkeys,
+                                &rows, &width, &startup_cost, &total_cost, &option_set);
+
+        add_path(baserel, (Path *)
+#if PG_VERSION_NUM < 90500
+                 create_foreignscan_path(root, baserel,
+                                         rows,
+                                         startup_cost,
+                                         total_cost,
+                                         usable_pathkeys,
+                                         NULL,
+                                         NIL));
+#elif PG_VERSION_NUM < 90600
+                 create_foreignscan_path(root, baserel,
+                                         rows,
+                                         startup_cost,
+                                         total_cost,
+                                         usable_pathkeys,
+                                         NULL,
+                                         NULL,
+                                         NIL));
+#elif PG_VERSION_NUM < 170000
+                 create_foreignscan_path(root, baserel,
+                                         NULL,
+                                         rows,
+                                         startup_cost,
+                                         total_cost,
+                                         usable_pathkeys,
+                                         NULL,
+                                         NULL,
+                                         NIL));
+#elif PG_VERSION_NUM < 180000
+                 create_foreignscan_path(root, baserel,
+                                         NULL,
+                                         rows,
+                                         startup_cost,
+                                         total_cost,
+                                         usable_pathkeys,
+                                         NULL,
+                                         NULL,
+                                         NIL,
+                                         NIL));
+#else
+                 create_foreignscan_path(root, baserel,
+                                         NULL,
+                                         rows,
+                                         0,
+                                         startup_cost,
+                                         total_cost,
+                                         usable_pathkeys,
+                                         NULL,
+                                         NULL,
+                                         NIL,
+                                         NIL));
+#endif /* PG_VERSION_NUM < 90500 */
+    }
+    
+#ifdef PARALLEL_API
+    /*
+     * With partition_column, the rows can be fetched and processed by
+     * parallel workers, each of them scanning ranges of its values. The
+     * minimum and maximum are read first, which takes two more queries.
+     */
+    if (baserel->consider_parallel && max_parallel_workers_per_gather > 0 &&
+        tdsCanSplitByRanges(foreigntableid, &option_set))
+    {
+        int         parallel_workers = max_parallel_workers_per_gather;
+        double      divisor = parallel_workers + 1;
+        Cost        startup_cost;
+        Cost        total_cost;
+
+        startup_cost = fpinfo->startup_cost +
+            2 * (fpinfo->fdw_startup_cost + fpinfo->network_startup_cost);
+        total_cost = startup_cost +
+            (fpinfo->total_cost - fpinfo->startup_cost) / divisor;
+
+#if PG_VERSION_NUM < 170000
+        path = create_foreignscan_path(root, baserel, NULL,
+                                       clamp_row_est(fpinfo->rows / divisor),
+                                       startup_cost,
+                                       total_cost,
+                                       NIL, /* no pathkeys */
+                                       NULL,        /* no outer rel either */
+                                       NULL,        /* no extra plan */
+                                       NIL);        /* no fdw_private list */
+#elif PG_VERSION_NUM < 180000
+        path = create_foreignscan_path(root, baserel, NULL,
+                                       clamp_row_est(fpinfo->rows / divisor),
+                                       startup_cost,
+                                       total_cost,
+                                       NIL, /* no pathkeys */
+                                       NULL,                /* no outer rel either */
+                                       NULL,                /* no extra plan */
+                                       NIL,                 /* no fdw_restrictinfo list */
+                                       NIL);                /* no fdw_private list */
+#else
+        path = create_foreignscan_path(root, baserel, NULL,
+                                       clamp_row_est(fpinfo->rows / divisor),
+                                       0,                   /* no disabled plan nodes */
+                                       startup_cost,
+                                       total_cost,
+                                       NIL, /* no pathkeys */
+                                       NULL,                /* no outer rel either */
+                                       NULL,                /* no extra plan */
+                                       NIL,                 /* no fdw_restrictinfo list */
+                                       NIL);                /* no fdw_private list */
+#endif /* PG_VERSION_NUM < 170000 */
+
+        path->path.parallel_aware = true;
+        path->path.parallel_workers = parallel_workers;
+
+        add_partial_path(baserel, (Path *) path);
+    }
+#endif  /* PARALLEL_API */
+
+    /* Don't worry about join pushdowns unless this is PostgreSQL 9.5+ */
+    #if (PG_VERSION_NUM >= 90500)
+
+    /*
+     * If we're not using remote estimates, stop here.  We have no way to
+     * estimate whether any join clauses would be worth sending across, so
+     * don't bother building parameterized paths.
+     */
+    if (!fpinfo->use_remote_estimate)
+        return;
+
+    /*
+     * Thumb through all join clauses for the rel to identify which outer
+     * relations could supply one or more safe-to-send-to-remote join clauses.
+     * We'll build a parameterized path for each such outer relation.
+     *
+     * It's convenient to manage this by representing each candidate outer
+     * relation by the ParamPathInfo node for it.  We can then use the
+     * ppi_clauses list in the ParamPathInfo node directly as a list of the
+     * interesting join clauses for that rel.  This takes care of the
+     * possibility that there are multiple safe join clauses for such a rel,
+     * and also ensures that we account for unsafe join clauses that we'll
+     * still have to enforce locally (since the parameterized-path machinery
+     * insists that we handle all movable clauses).
+     */
+    ppi_list = NIL;
+    foreach(lc, baserel->joininfo)
+    {
+        RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+        Relids      required_outer;
+        ParamPathInfo *param_info;
+
+        /* Check if clause can be moved to this rel */
+        if (!join_clause_is_movable_to(rinfo, baserel))
+            continue;
+
+        /* See if it is safe to send to remote */
+        if (!is_foreign_expr(root, baserel, rinfo->clause))
+            continue;
+
+        /* Calculate required outer rels for the resulting path */
+        required_outer = bms_union(rinfo->clause_relids,
+                                   baserel->lateral_relids);
+        /* We do not want the foreign rel itself listed in required_outer */
+        required_outer = bms_del_member(required_outer, baserel->relid);
+
+        /*
+         * required_outer probably can't be empty here, but if it were, we
+         * couldn't make a parameterized path.
+         */
+        if (bms_is_empty(required_outer))
+            continue;
+
+        /* Get the ParamPathInfo */
+        param_info = get_baserel_parampathinfo(root, baserel,
+                                               required_outer);
+        Assert(param_info != NULL);
+
+        /*
+         * Add it to list unless we already have it.  Testing pointer equality
+         * is OK since get_baserel_parampathinfo won't make duplicates.
+         */
+        ppi_list = list_append_unique_ptr(ppi_list, param_info);
+    }
+
+    /*
+     * The above scan examined only "generic" join clauses, not those that
+     * were absorbed into EquivalenceClauses.  See if we can make anything out
+     * of EquivalenceClauses.
+     */
+    if (baserel->has_eclass_joins)
+    {
+        /*
+         * We repeatedly scan the eclass list looking for column references
+         * (or expressions) belonging to the foreign rel.  Each time we find
+         * one, we generate a list of equivalence joinclauses for it, and then
+         * see if any are safe to send to the remote.  Repeat till there are
+         * no more candidate EC members.
+         */
+        ec_member_foreign_arg arg;
+
+        arg.already_used = NIL;
+        for (;;)
+        {
+            List       *clauses;
+
+            /* Make clauses, skipping any that join to lateral_referencers */
+            arg.current = NULL;
+            clauses = generate_implied_equalities_for_column(root,
+                                                             baserel,
+                                                   ec_member_matches_foreign,
+                                                             (void *) &arg,
+                                               baserel->lateral_referencers);
+
+            /* Done if there are no more expressions in the foreign rel */
+            if (arg.current == NULL)
+            {
+                Assert(clauses == NIL);
+                break;
+            }
+
+            /* Scan the extracted join clauses */
+            foreach(lc, clauses)
+            {
+                RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+                Relids      required_outer;
+                ParamPathInfo *param_info;
+
+                /* Check if clause can be moved to this rel */
+                if (!join_clause_is_movable_to(rinfo, baserel))
+                    continue;
+
+                /* See if it is safe to send to remote */
+                if (!is_foreign_expr(root, baserel, rinfo->clause))
+                    continue;
+
+                /* Calculate required outer rels for the resulting path */
+                required_outer = bms_union(rinfo->clause_relids,
+                                           baserel->lateral_relids);
+                required_outer = bms_del_member(required_outer, baserel->relid);
+                if (bms_is_empty(required_outer))
+                    continue;
+
+                /* Get the ParamPathInfo */
+                param_info = get_baserel_parampathinfo(root, baserel,
+                                                       required_outer);
+                Assert(param_info != NULL);
+
+                /* Add it to list unless we already have it */
+                ppi_list = list_append_unique_ptr(ppi_list, param_info);
+            }
+
+            /* Try again, now ignoring the expression we found this time */
+            arg.already_used = lappend(arg.already_used, arg.current);
+        }
+    }
+
+    /*
+     * Now build a path for each useful outer relation.
+     */
+    foreach(lc, ppi_list)
+    {
+        ParamPathInfo *param_info = (ParamPathInfo *) lfirst(lc);
+        double      rows;
+        int         width;
+        Cost        startup_cost;
+        Cost        total_cost;
+
+        /* Get a cost estimate from the remote */
+        estimate_path_cost_size(root, baserel,
+                                param_info->ppi_clauses, NIL,
+                                &rows, &width,
+                                &startup_cost, &total_cost, &option_set);
+
+        /*
+         * ppi_rows currently won't get looked at by anything, but still we
+         * may as well ensure that it matches our idea of the rowcount.
+         */
+        param_info->ppi_rows = rows;
+
+        /* Make the path */
+#if PG_VERSION_NUM < 90500
+        path = create_foreignscan_path(root, baserel,
+                                       rows,
+                                       startup_cost,
+                                       total_cost,
+                                       NIL,     /* no pathkeys */
+                                       param_info->ppi_req_outer,
+                                       NIL);    /* no fdw_private list */
+#elif PG_VERSION_NUM < 90600
+        path = create_foreignscan_path(root, baserel,
+                                       rows,
+                                       startup_cost,
+                                       total_cost,
+                                       NIL,     /* no pathkeys */
+                                       param_info->ppi_req_outer,
+                                       NULL,
+                                       NIL);    /* no fdw_private list */
+#elif PG_VERSION_NUM < 170000
+        path = create_foreignscan_path(root, baserel,
+                                       NULL,
+                                       rows,
+                                       startup_cost,
+                                       total_cost,
+                                       NIL,     /* no pathkeys */
+                                       param_info->ppi_req_outer,
+                                       NULL,
+                                       NIL);    /* no fdw_private list */
+#elif PG_VERSION_NUM < 180000
+        path = create_foreignscan_path(root, baserel,
+                                       NULL,
+                                       rows,
+                                       startup_cost,
+                                       total_cost,
+                                       NIL,     /* no pathkeys */
+                                       param_info->ppi_req_outer,
+                                       NULL,
+                                       NIL,     /* no fdw_restrictinfo list */
+                                       NIL);    /* no fdw_private list */
+#else
+        path = create_foreignscan_path(root, baserel,
+                                       NULL,
+                                       rows,
+                                       0,       /* no disabled plan nodes */
+                                       startup_cost,
+                                       total_cost,
+                                       NIL,     /* no pathkeys */
+                                       param_info->ppi_req_outer,
+                                       NULL,
+                                       NIL,     /* no fdw_restrictinfo list */
+                                       NIL);    /* no fdw_private list */
+#endif /* PG_VERSION_NUM < 90500 */
+        add_path(baserel, (Path *) path);
+    }
+    
+    #endif
+    
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> finishing tdsGetForeignPaths")
+            ));
+    #endif
+}
+
+/*
+ * the number of rows counted by tdsAnalyzeForeignTable(), so that the
+ * AcquireSampleRowsFunc doesn't need to count them again
+ */
+static Oid analyze_relid = InvalidOid;
+static double analyze_totalrows = 0;
+static bool analyze_is_table = false;
+
+/*
+ * get the number of rows of a foreign table for ANALYZE. The catalog
+ * statistics are used if the remote object has them, which is_table is set
+ * for, otherwise the rows are counted on the remote server.
+ */
+
+static double tdsGetAnalyzeRowCount(TdsFdwOptionSet* option_set, DBPROCESS *dbproc, bool *is_table)
+{
+    double rows = -1;
+    StringInfoData count_query;
+    
+    if (option_set->table_name)
+        rows = tdsGetRowCountPartitionStats(option_set, dbproc);
+    
+    *is_table = (rows >= 0);
+    
+    if (rows < 0)
+    {
+        initStringInfo(&count_query);
+        appendStringInfoString(&count_query, "SELECT CONVERT(FLOAT, COUNT(*)) FROM ");
+        
+        if (option_set->table_name)
+            tdsAppendRemoteRelation(&count_query, option_set);
+        else
+            appendStringInfo(&count_query, "(%s) AS tds_fdw_count", option_set->query);
+        
+        rows = tdsQueryDouble(count_query.data, dbproc, 0);
+    }
+    
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: The foreign table has %g rows", rows)
+        ));
+    
+    return rows;
+}
+
+/*
+ * find the local column of each remote column of a sample, by name if
+ * match_column_names is set, otherwise by position
+ */
+
+static List *tdsGetAnalyzeAttrs(TdsFdwAnalyzeState *astate, DBPROCESS *dbproc)
+{
+    TupleDesc tupdesc = RelationGetDescr(astate->rel);
+    Oid relid = RelationGetRelid(astate->rel);
+    List *attrs = NIL;
+    int ncols = dbnumcols(dbproc);
+    int ncol;
+    int i = 0;
+    
+    for (ncol = 0; ncol < ncols; ncol++)
+    {
+        char *remote_name = dbcolname(dbproc, ncol + 1);
+        int attnum = 0;
+        
+        for (; i < tupdesc->natts; i++)
+        {
+            char *local_name;
+            List *options;
+            ListCell *lc;
+            
+            if (TupleDescAttr(tupdesc, i)->attisdropped)
+                continue;
+            
+            if (!astate->match_column_names)
+            {
+                attnum = ++i;
+                break;
+            }
+            
+            local_name = NameStr(TupleDescAttr(tupdesc, i)->attname);
+            options = GetForeignColumnOptions(relid, i + 1);
+            
+            foreach(lc, options)
+            {
+                DefElem    *def = (DefElem *) lfirst(lc);
+                
+                if (strcmp(def->defname, "column_name") == 0)
+                    local_name = defGetString(def);
+            }
+            
+            if (strncmp(local_name, remote_name, NAMEDATALEN) == 0)
+            {
+                attnum = i + 1;
+                break;
+            }
+        }
+        
+        /* look at all of the local columns again for the next name */
+        if (astate->match_column_names)
+            i = 0;
+        
+        if (attnum == 0)
+        {
+            ereport(DEBUG3,
+                (errmsg("tds_fdw: Remote column %s is not in the local table. It will be ignored.", remote_name)
+                ));
+        }
+        
+        attrs = lappend_int(attrs, attnum);
+    }
+    
+    return attrs;
+}
+
+/*
+ * run a sampling query, and add the rows it returns to the sample in astate
+ */
+
+static void tdsAnalyzeFetchRows(TdsFdwAnalyzeState *astate, DBPROCESS *dbproc, char *query)
+{
+    TupleDesc tupdesc = RelationGetDescr(astate->rel);
+    Datum *values;
+    bool *nulls;
+    List *attrs;
+    int ncols;
+    int ret_code;
+    
+    ereport(DEBUG3,
+        (errmsg("tds_fdw: Getting sample rows with query %s", query)
+        ));
+    
+    /* the following option is needed to get a proper size for blobs */
+    if (dbsetopt(dbproc, DBTEXTSIZE, "2147483647", -1) == FAIL)
+    {
+        ereport(WARNING,
+            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                errmsg("Failed to set DBTEXTLIMIT server option, blob sizes may be truncated!")
+            ));
+    }
+    
+    if (!tdsExecuteQuery(query, dbproc))
+    {
+        ereport(ERROR,
+            (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                errmsg("Failed to get results from query %s", query)
+            ));
+    }
+    
+    ncols = dbnumcols(dbproc);
+    
+    if (astate->retrieved_attrs)
+        attrs = astate->retrieved_attrs;
+    else
+        attrs = tdsGetAnalyzeAttrs(astate, dbproc);
+    
+    if (ncols < list_length(attrs))
+    {
+        ereport(ERROR,
+            (errcode(ERRCODE_FDW_INCONSISTENT_DESCRIPTOR_INFORMATION),
+            errmsg("Table definition mismatch: Foreign source returned %d column(s),"
+                " but query expected %d column(s)",
+                ncols,
+                list_length(attrs))
+            ));
+    }
+    
+    values = (Datum *) palloc(tupdesc->natts * sizeof(Datum));
+    nulls = (bool *) palloc(tupdesc->natts * sizeof(bool));
+    
+    while ((ret_code = dbnextrow(dbproc)) != NO_MORE_ROWS)
+    {
+        int pos = -1;
+        
+        switch (ret_code)
+        {
+            case REG_ROW:
+                break;
+                
+            case BUF_FULL:
+                ereport(ERROR,
+                    (errcode(ERRCODE_FDW_OUT_OF_MEMORY),
+                    errmsg("Buffer filled up during query")
+                    ));
+                break;
+                    
+            case FAIL:
+                ereport(ERROR,
+                    (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                    errmsg("Failed to get row during query")
+                    ));
+                break;
+            
+            default:
+                ereport(ERROR,
+                    (errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+                    errmsg("Failed to get row during query. Unknown return code.")
+                    ));
+        }
+        
+        CHECK_FOR_INTERRUPTS();
+        
+        /*
+         * The first targrows rows are always kept. After that, a row replaces
+         * a random one of them, with the probability that gives each row the
+         * same chance to be in the sample.
+         */
+        if (astate->numrows < astate->targrows)
+            pos = astate->numrows++;
+        else
+        {
+            if (astate->rowstoskip < 0)
+#if (PG_VERSION_NUM >= 90500)
+                astate->rowstoskip = reservoir_get_next_S(&astate->rstate, astate->samplerows, astate->targrows);
+#else
+                astate->rowstoskip = anl_get_next_S(astate->samplerows, astate->targrows, &astate->rstate);
+#endif
+            
+            if (astate->rowstoskip <= 0)
+            {
+#if (PG_VERSION_NUM >= 150000)
+                pos = (int) (astate->targrows * sampler_random_fract(&astate->rstate.randstate));
+#elif (PG_VERSION_NUM >= 90500)
+                pos = (int) (astate->targrows * sampler_random_fract(astate->rstate.randstate));
+#else
+                pos = (int) (astate->targrows * anl_random_fract());
+#endif
+                Assert(pos >= 0 && pos < astate->targrows);
+                heap_freetuple(astate->rows[pos]);
+            }
+            
+            astate->rowstoskip -= 1;
+        }
+        
+        astate->samplerows += 1;
+        
+        if (pos >= 0)
+        {
+            MemoryContext old_cxt;
+            ListCell *lc;
+            int ncol = 0;
+            
+            old_cxt = MemoryContextSwitchTo(astate->temp_cxt);
+            
+            memset(values, 0, tupdesc->natts * sizeof(Datum));
+            memset(nulls, true, tupdesc->natts * sizeof(bool));
+            
+            foreach(lc, attrs)
             {
-                RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
-                Relids      required_outer;
-                ParamPathInfo *param_info;
-
-                /* Check if clause can be moved to this rel */
-                if (!join_clause_is_movable_to(rinfo, baserel))
-                    continue;
-
-                /* See if it is safe to send to remote */
-                if (!is_foreign_expr(root, baserel, rinfo->clause))
+                int attnum = lfirst_int(lc);
+                DBINT srclen;
+                BYTE *src;
+                char *cstring;
+                
+                ncol++;
+                
+                if (attnum == 0)
                     continue;
-
-                /* Calculate required outer rels for the resulting path */
-                required_outer = bms_union(rinfo->clause_relids,
-                                           baserel->lateral_relids);
-                required_outer = bms_del_member(required_outer, baserel->relid);
-                if (bms_is_empty(required_outer))
+                
+                srclen = dbdatlen(dbproc, ncol);
+                src = dbdata(dbproc, ncol);
+                
+                if (srclen == 0 || src == NULL)
                     continue;
-
-                /* Get the ParamPathInfo */
-                param_info = get_baserel_parampathinfo(root, baserel,
-                                                       required_outer);
-                Assert(param_info != NULL);
-
-                /* Add it to list unless we already have it */
-                ppi_list = list_append_unique_ptr(ppi_list, param_info);
+                
+                cstring = tdsConvertToCString(dbproc, dbcoltype(dbproc, ncol), src, srclen);
+                values[attnum - 1] = InputFunctionCall(&astate->attinmeta->attinfuncs[attnum - 1],
+                                                       cstring,
+                                                       astate->attinmeta->attioparams[attnum - 1],
+                                                       astate->attinmeta->atttypmods[attnum - 1]);
+                nulls[attnum - 1] = false;
             }
-
-            /* Try again, now ignoring the expression we found this time */
-            arg.already_used = lappend(arg.already_used, arg.current);
+            
+            /* the sample rows have to outlive the temporary context */
+            MemoryContextSwitchTo(astate->anl_cxt);
+            astate->rows[pos] = heap_form_tuple(tupdesc, values, nulls);
+            
+            MemoryContextSwitchTo(old_cxt);
+            MemoryContextReset(astate->temp_cxt);
         }
     }
+    
+    pfree(values);
+    pfree(nulls);
+}
 
-    /*
-     * Now build a path for each useful outer relation.
-     */
-    foreach(lc, ppi_list)
-    {
-        ParamPathInfo *param_info = (ParamPathInfo *) lfirst(lc);
-        double      rows;
-        int         width;
-        Cost        startup_cost;
-        Cost        total_cost;
-
-        /* Get a cost estimate from the remote */
-        estimate_path_cost_size(root, baserel,
-                                param_info->ppi_clauses, NIL,
-                                &rows, &width,
-                                &startup_cost, &total_cost, &option_set);
-
-        /*
-         * ppi_rows currently won't get looked at by anything, but still we
-         * may as well ensure that it matches our idea of the rowcount.
-         */
-        param_info->ppi_rows = rows;
+/*
+ * acquire a random sample of rows from the foreign table for ANALYZE.
+ *
+ * Only the sample crosses the wire: SQL Server tables are sampled with
+ * TABLESAMPLE, which reads random pages, while views, tables defined with
+ * the query option, and Sybase take the first rows in random order. As
+ * TABLESAMPLE returns a varying number of rows, it is asked for twice as many
+ * as needed, and the rows are then sampled once more locally.
+ */
 
-        /* Make the path */
-#if PG_VERSION_NUM < 90500
-        path = create_foreignscan_path(root, baserel,
-                                       rows,
-                                       startup_cost,
-                                       total_cost,
-                                       NIL,     /* no pathkeys */
-                                       param_info->ppi_req_outer,
-                                       NIL);    /* no fdw_private list */
-#elif PG_VERSION_NUM < 90600
-        path = create_foreignscan_path(root, baserel,
-                                       rows,
-                                       startup_cost,
-                                       total_cost,
-                                       NIL,     /* no pathkeys */
-                                       param_info->ppi_req_outer,
-                                       NULL,
-                                       NIL);    /* no fdw_private list */
-#elif PG_VERSION_NUM < 170000
-        path = create_foreignscan_path(root, baserel,
-                                       NULL,
-                                       rows,
-                                       startup_cost,
-                                       total_cost,
-                                       NIL,     /* no pathkeys */
-                                       param_info->ppi_req_outer,
-                                       NULL,
-                                       NIL);    /* no fdw_private list */
-#elif PG_VERSION_NUM < 180000
-        path = create_foreignscan_path(root, baserel,
-                                       NULL,
-                                       rows,
-                                       startup_cost,
-                                       total_cost,
-                                       NIL,     /* no pathkeys */
-                                       param_info->ppi_req_outer,
-                                       NULL,
-                                       NIL,     /* no fdw_restrictinfo list */
-                                       NIL);    /* no fdw_private list */
+static int tdsAcquireSampleRowsFunc(Relation relation, int elevel,
+    HeapTuple *rows, int targrows, double *totalrows, double *totaldeadrows)
+{
+    TdsFdwOptionSet option_set;
+    TdsFdwAnalyzeState astate;
+    DBPROCESS *dbproc;
+    Oid relid = RelationGetRelid(relation);
+    StringInfoData base_sql;
+    StringInfoData sql;
+    double remote_rows;
+    bool is_table;
+    
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> starting tdsAcquireSampleRowsFunc")
+            ));
+    #endif
+    
+    tdsGetForeignTableOptionsFromCatalog(relid, &option_set);
+    
+    memset(&astate, 0, sizeof(astate));
+    astate.rel = relation;
+    astate.attinmeta = TupleDescGetAttInMetadata(RelationGetDescr(relation));
+    astate.match_column_names = option_set.match_column_names;
+    astate.rows = rows;
+    astate.targrows = targrows;
+    astate.numrows = 0;
+    astate.samplerows = 0;
+    astate.rowstoskip = -1;
+#if (PG_VERSION_NUM >= 90500)
+    reservoir_init_selection_state(&astate.rstate, targrows);
 #else
-        path = create_foreignscan_path(root, baserel,
-                                       NULL,
-                                       rows,
-                                       0,       /* no disabled plan nodes */
-                                       startup_cost,
-                                       total_cost,
-                                       NIL,     /* no pathkeys */
-                                       param_info->ppi_req_outer,
-                                       NULL,
-                                       NIL,     /* no fdw_restrictinfo list */
-                                       NIL);    /* no fdw_private list */
-#endif /* PG_VERSION_NUM < 90500 */
-        add_path(baserel, (Path *) path);
+    astate.rstate = anl_init_selection_state(targrows);
+#endif
+    astate.anl_cxt = CurrentMemoryContext;
+    astate.temp_cxt = AllocSetContextCreate(CurrentMemoryContext,
+                                            "tds_fdw temporary data",
+                                            ALLOCSET_SMALL_SIZES);
+    
+    dbproc = tdsGetConnection(GetForeignTable(relid)->serverid, &option_set);
+    
+    if (analyze_relid == relid)
+    {
+        remote_rows = analyze_totalrows;
+        is_table = analyze_is_table;
     }
+    else
+        remote_rows = tdsGetAnalyzeRowCount(&option_set, dbproc, &is_table);
+    
+    analyze_relid = InvalidOid;
+    
+    /* the query for all of the rows */
+    initStringInfo(&base_sql);
+    
+    if (option_set.table_name)
+    {
+        deparseAnalyzeSql(&base_sql, relation, &astate.retrieved_attrs);
+        
+        /* the SELECT list was built from the local columns */
+        astate.match_column_names = false;
+    }
+    else
+        appendStringInfoString(&base_sql, option_set.query);
+    
+    initStringInfo(&sql);
+    
+    if (remote_rows <= targrows)
+        appendStringInfoString(&sql, base_sql.data);
+    
+    else if (is_table && tdsIsSqlServer(dbproc))
+    {
+        double percent = Min(100.0, 100.0 * 2 * targrows / remote_rows);
+        
+        appendStringInfo(&sql, "%s TABLESAMPLE SYSTEM (%f PERCENT)", base_sql.data, percent);
+    }
+    
+    if (sql.len > 0)
+        tdsAnalyzeFetchRows(&astate, dbproc, sql.data);
+    
+    /* TABLESAMPLE may miss every page of a small table */
+    if (sql.len == 0 || (astate.numrows == 0 && remote_rows > 0))
+    {
+        resetStringInfo(&sql);
+        appendStringInfo(&sql, "SELECT TOP %i * FROM (%s) AS tds_fdw_sample ORDER BY NEWID()",
+            targrows, base_sql.data);
+        
+        tdsAnalyzeFetchRows(&astate, dbproc, sql.data);
+    }
+    
+    tdsReleaseConnection(dbproc);
+    
+    MemoryContextDelete(astate.temp_cxt);
+    
+    /* if every row was fetched, we know how many there are */
+    if (remote_rows <= targrows)
+        *totalrows = astate.samplerows;
+    else
+        *totalrows = Max(remote_rows, astate.samplerows);
+    
+    *totaldeadrows = 0;
+    
+    ereport(elevel,
+        (errmsg("\"%s\": table contains %.0f rows, %d rows in sample",
+            RelationGetRelationName(relation),
+            *totalrows, astate.numrows)
+        ));
+    
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> finishing tdsAcquireSampleRowsFunc")
+            ));
+    #endif
+    
+    return astate.numrows;
+}
+
+/*
+ * import the statistics MS SQL Server keeps for the table, for
+ * analyze_method 'histogram'. No rows are returned, so ANALYZE keeps the
+ * pg_statistic entries written here and only updates the number of rows.
+ * If there are no remote statistics to import, rows are sampled instead.
+ */
+
+static int tdsAcquireHistogramFunc(Relation relation, int elevel,
+    HeapTuple *rows, int targrows, double *totalrows, double *totaldeadrows)
+{
+    int ncolumns = 0;
+#ifdef TDS_IMPORT_REMOTE_STATISTICS
+    TdsFdwOptionSet option_set;
+    DBPROCESS *dbproc;
+    Oid relid = RelationGetRelid(relation);
+    StringInfoData remote_relation;
     
+    #ifdef DEBUG
+        ereport(NOTICE,
+            (errmsg("----> starting tdsAcquireHistogramFunc")
+            ));
     #endif
     
+    tdsGetForeignTableOptionsFromCatalog(relid, &option_set);
+    
+    /* only tables have statistics */
+    if (analyze_relid == relid && analyze_is_table)
+    {
+        dbproc = tdsGetConnection(GetForeignTable(relid)->serverid, &option_set);
+        
+        if (tdsIsSqlServer(dbproc))
+        {
+            initStringInfo(&remote_relation);
+            tdsAppendRemoteRelation(&remote_relation, &option_set);
+            
+            ncolumns = tdsImportRemoteStatistics(relation, dbproc, remote_relation.data,
+                option_set.match_column_names);
+        }
+        
+        tdsReleaseConnection(dbproc);
+    }
+    
     #ifdef DEBUG
         ereport(NOTICE,
-            (errmsg("----> finishing tdsGetForeignPaths")
+            (errmsg("----> finishing tdsAcquireHistogramFunc")
             ));
     #endif
+#endif  /* TDS_IMPORT_REMOTE_STATISTICS */
+    
+    if (ncolumns == 0)
+    {
+        ereport(WARNING,
+            (errmsg("No remote statistics to import for \"%s\", sampling rows instead",
+                RelationGetRelationName(relation))
+            ));
+        
+        return tdsAcquireSampleRowsFunc(relation, elevel, rows, targrows, totalrows, totaldeadrows);
+    }
+    
+    ereport(elevel,
+        (errmsg("\"%s\": table contains %.0f rows, imported remote statistics for %d columns",
+            RelationGetRelationName(relation),
+            analyze_totalrows, ncolumns)
+        ));
+    
+    *totalrows = analyze_totalrows;
+    *totaldeadrows = 0;
+    analyze_relid = InvalidOid;
+    
+    return 0;
 }
 
 bool tdsAnalyzeForeignTable(Relation relation, AcquireSampleRowsFunc *func, BlockNumber *totalpages)
 {
+    TdsFdwOptionSet option_set;
+    DBPROCESS *dbproc;
+    Oid relid = RelationGetRelid(relation);
+    int32 width;
+    double pages;
+    
     #ifdef DEBUG
         ereport(NOTICE,
             (errmsg("----> starting tdsAnalyzeForeignTable")
             ));
     #endif
     
+    tdsGetForeignTableOptionsFromCatalog(relid, &option_set);
+    
+    dbproc = tdsGetConnection(GetForeignTable(relid)->serverid, &option_set);
+    analyze_totalrows = tdsGetAnalyzeRowCount(&option_set, dbproc, &analyze_is_table);
+    analyze_relid = relid;
+    tdsReleaseConnection(dbproc);
+    
+    /* the number of pages the rows would take locally */
+    width = get_relation_data_width(relid, NULL) + MAXALIGN(offsetof(HeapTupleHeaderData, t_bits));
+    pages = ceil(analyze_totalrows * width / BLCKSZ);
+    
+    *totalpages = (BlockNumber) Max(pages, 1);
+    
+    if (strcmp(option_set.analyze_method, "histogram") == 0)
+        *func = tdsAcquireHistogramFunc;
+    else
+        *func = tdsAcquireSampleRowsFunc;
+    
     #ifdef DEBUG
         ereport(NOTICE,
             (errmsg("----> finishing tdsAnalyzeForeignTable")
             ));
     #endif
     
-    return false;
+    return true;
 }
 #if (PG_VERSION_NUM >= 90500)
 ForeignScan* tdsGetForeignPlan(PlannerInfo *root, RelOptInfo *baserel, 
@@ -3025,6 +5221,7 @@ ForeignScan* tdsGetForeignPlan(PlannerInfo *root, RelOptInfo *baserel,
     List       *local_exprs = NIL;
     List       *params_list = NIL;
     List       *retrieved_attrs = NIL;
+    char       *range_column = "";
     ListCell   *lc;
     
     #ifdef DEBUG
@@ -3089,12 +5286,19 @@ ForeignScan* tdsGetForeignPlan(PlannerInfo *root, RelOptInfo *baserel,
         fpinfo->attrs_used, &retrieved_attrs, 
         remote_conds, NULL, best_path->path.pathkeys);
 
+#ifdef PARALLEL_API
+    if (best_path->path.parallel_aware)
+        range_column = pstrdup(tds_quote_identifier(option_set.partition_column));
+#endif  /* PARALLEL_API */
+
     /*
      * Build the fdw_private list that will be available to the executor.
      * Items in the list must match enum FdwScanPrivateIndex, above.
      */
-    fdw_private = list_make2(makeString(option_set.query),
-                             retrieved_attrs);
+    fdw_private = list_make4(makeString(option_set.query),
+                             retrieved_attrs,
+                             makeString(range_column),
+                             makeInteger(remote_conds != NIL));
 
     /*
      * Create the ForeignScan node from target list, filtering expressions,
@@ -4105,7 +6309,6 @@ List *tdsImportForeignSchema(ImportForeignSchemaStmt *stmt, Oid serverOid)
     bool        keep_custom_types = false;
     ListCell   *lc;
 
-    LOGINREC   *login;
     DBPROCESS  *dbproc;
 
     #ifdef DEBUG
@@ -4133,59 +6336,7 @@ List *tdsImportForeignSchema(ImportForeignSchemaStmt *stmt, Oid serverOid)
 
     tdsGetForeignServerOptionsFromCatalog(serverOid, &option_set);
 
-    ereport(DEBUG3,
-        (errmsg("tds_fdw: Initiating DB-Library")
-        ));
-
-    if (dbinit() == FAIL)
-    {
-        ereport(ERROR,
-            (errcode(ERRCODE_FDW_OUT_OF_MEMORY),
-                errmsg("Failed to initialize DB-Library environment")
-            ));
-        goto cleanup_before_init;
-    }
-
-    dberrhandle(tds_err_handler);
-
-    if (option_set.msg_handler)
-    {
-        if (strcmp(option_set.msg_handler, "notice") == 0)
-        {
-            dbmsghandle(tds_notice_msg_handler);
-        }
-
-        else if (strcmp(option_set.msg_handler, "blackhole") == 0)
-        {
-            dbmsghandle(tds_blackhole_msg_handler);
-        }
-
-        else
-        {
-            ereport(ERROR,
-                (errcode(ERRCODE_SYNTAX_ERROR),
-                    errmsg("Unknown msg handler: %s.", option_set.msg_handler)
-                ));
-        }
-    }
-
-    ereport(DEBUG3,
-        (errmsg("tds_fdw: Getting login structure")
-        ));
-
-    if ((login = dblogin()) == NULL)
-    {
-        ereport(ERROR,
-            (errcode(ERRCODE_FDW_OUT_OF_MEMORY),
-                errmsg("Failed to initialize DB-Library login structure")
-            ));
-        goto cleanup_before_login;
-    }
-
-    if (tdsSetupConnection(&option_set, login, &dbproc) != 0)
-    {
-        goto cleanup;
-    }
+    dbproc = tdsGetConnection(serverOid, &option_set);
 
     if (tdsIsSqlServer(dbproc))
         commands = tdsImportSqlServerSchema(stmt, dbproc, option_set,
@@ -4195,15 +6346,7 @@ List *tdsImportForeignSchema(ImportForeignSchemaStmt *stmt, Oid serverOid)
                                          import_default, import_not_null,
                                          keep_custom_types);
 
-cleanup:
-    dbclose(dbproc);
-    dbloginfree(login);
-
-cleanup_before_login:
-    dbexit();
-
-cleanup_before_init:
-    ;
+    tdsReleaseConnection(dbproc);
 
     #ifdef DEBUG
         ereport(NOTICE,
@@ -4248,6 +6391,17 @@ int tds_err_handler(DBPROCESS *dbproc, int severity, int dberr, int oserr, char
             ));
     #endif
 
+    /*
+     * Remote estimates with estimate_timeout are cancelled when they time
+     * out, and fall back to another estimate.
+     */
+    if (dberr == SYBETIME && estimate_timeout_active)
+    {
+        estimate_timed_out = true;
+
+        return INT_CANCEL;
+    }
+
     /* Character set conversions should be non-fatal */
     if (dberr == 2403)
     {
@@ -4290,6 +6444,21 @@ int tds_notice_msg_handler(DBPROCESS *dbproc, DBINT msgno, int msgstate, int sev
     return 0;
 }
 
+/*
+ * DB-Library has a single message handler per process, so this one passes
+ * the message on to the handler chosen by the msg_handler option of the
+ * connection it came from.
+ */
+int tds_msg_handler(DBPROCESS *dbproc, DBINT msgno, int msgstate, int severity, char *msgtext, char *svr_name, char *proc_name, int line)
+{
+    TdsFdwConnState *state = tdsGetConnState(dbproc);
+
+    if (state == NULL)
+        return tds_blackhole_msg_handler(dbproc, msgno, msgstate, severity, msgtext, svr_name, proc_name, line);
+
+    return state->msg_handler(dbproc, msgno, msgstate, severity, msgtext, svr_name, proc_name, line);
+}
+
 int tds_blackhole_msg_handler(DBPROCESS *dbproc, DBINT msgno, int msgstate, int severity, char *msgtext, char *svr_name, char *proc_name, int line)
 {
     #ifdef DEBUG
@@ -0,0 +1,12 @@
+IF OBJECT_ID('@SCHEMANAME.decimal18', 'U') IS NOT NULL
+        DROP TABLE @SCHEMANAME.decimal18;
+
+CREATE TABLE @SCHEMANAME.decimal18 (
+        id int primary key,
+        value decimal(18, 4),
+        wide_value decimal(38, 10)
+);
+
+INSERT INTO @SCHEMANAME.decimal18 (id, value, wide_value) VALUES (1, 12345678901234.5678, 1234567890123456789012345678.0123456789);
+INSERT INTO @SCHEMANAME.decimal18 (id, value, wide_value) VALUES (2, -99999999999999.9999, -0.0000000001);
+INSERT INTO @SCHEMANAME.decimal18 (id, value, wide_value) VALUES (3, 0, NULL);
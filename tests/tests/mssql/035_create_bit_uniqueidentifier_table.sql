@@ -0,0 +1,11 @@
+IF OBJECT_ID('@SCHEMANAME.bit_uniqueidentifier', 'U') IS NOT NULL
+        DROP TABLE @SCHEMANAME.bit_uniqueidentifier;
+
+CREATE TABLE @SCHEMANAME.bit_uniqueidentifier (
+        id int primary key,
+        flag bit,
+        guid uniqueidentifier
+);
+
+INSERT INTO @SCHEMANAME.bit_uniqueidentifier (id, flag, guid) VALUES (1, 1, '6F9619FF-8B86-D011-B42D-00C04FC964FF');
+INSERT INTO @SCHEMANAME.bit_uniqueidentifier (id, flag, guid) VALUES (2, 0, NULL);
@@ -0,0 +1,27 @@
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.estimate_cache;
+
+CREATE FOREIGN TABLE @PSCHEMANAME.estimate_cache (
+        id int,
+        data varchar(50)
+)
+        SERVER mssql_svr
+        OPTIONS (schema_name '@MSCHEMANAME', table_name 'view_simple', use_remote_estimate 'true');
+
+SET tds_fdw.estimate_cache_ttl = 60;
+
+SELECT tds_fdw_estimate_cache_reset();
+
+/* the second plan should reuse the estimate of the first one */
+EXPLAIN SELECT * FROM @PSCHEMANAME.estimate_cache WHERE id = 1;
+EXPLAIN SELECT * FROM @PSCHEMANAME.estimate_cache WHERE id = 1;
+
+DO $$BEGIN
+   IF NOT EXISTS (SELECT 1 FROM tds_fdw_estimate_cache() WHERE hits > 0)
+   THEN
+      RAISE EXCEPTION 'remote estimate was not reused';
+   END IF;
+END;$$;
+
+SELECT tds_fdw_estimate_cache_reset();
+
+RESET tds_fdw.estimate_cache_ttl;
@@ -0,0 +1,25 @@
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.partition_stats_table;
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.partition_stats_view;
+
+CREATE FOREIGN TABLE @PSCHEMANAME.partition_stats_table (
+        id int,
+        value smallint
+)
+        SERVER mssql_svr
+        OPTIONS (schema_name '@MSCHEMANAME', table_name 'tinyint_min', use_remote_estimate 'true', row_estimate_method 'partition_stats');
+
+/* a view has no statistics, so the query is executed instead */
+CREATE FOREIGN TABLE @PSCHEMANAME.partition_stats_view (
+        id int,
+        data varchar(50)
+)
+        SERVER mssql_svr
+        OPTIONS (schema_name '@MSCHEMANAME', table_name 'view_simple', use_remote_estimate 'true', row_estimate_method 'partition_stats');
+
+EXPLAIN SELECT * FROM @PSCHEMANAME.partition_stats_table WHERE id = 1;
+EXPLAIN SELECT * FROM @PSCHEMANAME.partition_stats_view WHERE id = 1;
+
+SELECT * FROM @PSCHEMANAME.partition_stats_table;
+
+DROP FOREIGN TABLE @PSCHEMANAME.partition_stats_table;
+DROP FOREIGN TABLE @PSCHEMANAME.partition_stats_view;
@@ -0,0 +1,15 @@
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.showplan_batch;
+
+CREATE FOREIGN TABLE @PSCHEMANAME.showplan_batch (
+        id int,
+        value smallint
+)
+        SERVER mssql_svr
+        OPTIONS (schema_name '@MSCHEMANAME', table_name 'tinyint_min', use_remote_estimate 'true', row_estimate_method 'showplan_all');
+
+/* the sorted and unsorted scans are estimated together */
+EXPLAIN SELECT * FROM @PSCHEMANAME.showplan_batch WHERE id > 0 ORDER BY id;
+
+SELECT * FROM @PSCHEMANAME.showplan_batch WHERE id > 0 ORDER BY id;
+
+DROP FOREIGN TABLE @PSCHEMANAME.showplan_batch;
@@ -0,0 +1,26 @@
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.analyze_table;
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.analyze_query;
+
+CREATE FOREIGN TABLE @PSCHEMANAME.analyze_table (
+        id int,
+        value smallint
+)
+        SERVER mssql_svr
+        OPTIONS (schema_name '@MSCHEMANAME', table_name 'tinyint_min');
+
+CREATE FOREIGN TABLE @PSCHEMANAME.analyze_query (
+        id int,
+        value smallint
+)
+        SERVER mssql_svr
+        OPTIONS (query 'SELECT id, value FROM @MSCHEMANAME.tinyint_min');
+
+ANALYZE @PSCHEMANAME.analyze_table;
+ANALYZE @PSCHEMANAME.analyze_query;
+
+SELECT (reltuples = 1) AS pass FROM pg_class WHERE oid = '@PSCHEMANAME.analyze_table'::regclass;
+SELECT (reltuples = 1) AS pass FROM pg_class WHERE oid = '@PSCHEMANAME.analyze_query'::regclass;
+SELECT attname, null_frac FROM pg_stats WHERE schemaname = '@PSCHEMANAME' AND tablename = 'analyze_table' ORDER BY attname;
+
+DROP FOREIGN TABLE @PSCHEMANAME.analyze_table;
+DROP FOREIGN TABLE @PSCHEMANAME.analyze_query;
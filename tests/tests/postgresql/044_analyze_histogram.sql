@@ -0,0 +1,16 @@
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.analyze_histogram;
+
+CREATE FOREIGN TABLE @PSCHEMANAME.analyze_histogram (
+        id int,
+        value smallint
+)
+        SERVER mssql_svr
+        OPTIONS (schema_name '@MSCHEMANAME', table_name 'tinyint_min', analyze_method 'histogram');
+
+/* the primary key on id has statistics on the remote server */
+ANALYZE @PSCHEMANAME.analyze_histogram;
+
+SELECT (reltuples = 1) AS pass FROM pg_class WHERE oid = '@PSCHEMANAME.analyze_histogram'::regclass;
+SELECT (null_frac = 0) AS pass FROM pg_stats WHERE schemaname = '@PSCHEMANAME' AND tablename = 'analyze_histogram' AND attname = 'id';
+
+DROP FOREIGN TABLE @PSCHEMANAME.analyze_histogram;
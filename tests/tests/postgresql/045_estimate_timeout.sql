@@ -0,0 +1,39 @@
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.estimate_timeout_table;
+
+CREATE FOREIGN TABLE @PSCHEMANAME.estimate_timeout_table (
+        id int,
+        value smallint
+)
+        SERVER mssql_svr
+        OPTIONS (schema_name '@MSCHEMANAME', table_name 'tinyint_min', use_remote_estimate 'true', estimate_timeout '5');
+
+EXPLAIN SELECT * FROM @PSCHEMANAME.estimate_timeout_table WHERE id = 1;
+
+SELECT * FROM @PSCHEMANAME.estimate_timeout_table;
+
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.estimate_timeout_slow_table;
+
+-- the remote estimate takes longer than estimate_timeout, so it falls back to local_tuple_estimate
+CREATE FOREIGN TABLE @PSCHEMANAME.estimate_timeout_slow_table (
+        id int,
+        value smallint
+)
+        SERVER mssql_svr
+        OPTIONS (query 'WAITFOR DELAY ''00:00:05''; SELECT id, value FROM @MSCHEMANAME.tinyint_min',
+                 use_remote_estimate 'true', estimate_timeout '1', local_tuple_estimate '123');
+
+DO $$DECLARE
+   plan json;
+BEGIN
+   EXECUTE 'EXPLAIN (FORMAT JSON) SELECT * FROM @PSCHEMANAME.estimate_timeout_slow_table' INTO plan;
+
+   IF (plan->0->'Plan'->>'Plan Rows')::float <> 123 THEN
+      RAISE EXCEPTION 'the remote estimate did not fall back to local_tuple_estimate: %', plan;
+   END IF;
+END;$$;
+
+-- the connection of the cancelled estimate was closed, so another one is used
+SELECT * FROM @PSCHEMANAME.estimate_timeout_table;
+
+DROP FOREIGN TABLE @PSCHEMANAME.estimate_timeout_slow_table;
+DROP FOREIGN TABLE @PSCHEMANAME.estimate_timeout_table;
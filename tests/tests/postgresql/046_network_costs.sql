@@ -0,0 +1,23 @@
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.network_costs;
+
+CREATE FOREIGN TABLE @PSCHEMANAME.network_costs (
+        id int,
+        value smallint
+)
+        SERVER mssql_svr
+        OPTIONS (schema_name '@MSCHEMANAME', table_name 'tinyint_min');
+
+/* opening the connection measures the latency of the server */
+SELECT * FROM @PSCHEMANAME.network_costs;
+
+DO $$BEGIN
+   IF NOT EXISTS (SELECT 1 FROM tds_fdw_server_stats() s JOIN pg_foreign_server f ON f.oid = s.serverid
+                  WHERE f.srvname = 'mssql_svr' AND s.round_trips > 0 AND s.rtt_ms >= 0)
+   THEN
+      RAISE EXCEPTION 'round trip time was not measured';
+   END IF;
+END;$$;
+
+EXPLAIN SELECT * FROM @PSCHEMANAME.network_costs WHERE id = 1;
+
+DROP FOREIGN TABLE @PSCHEMANAME.network_costs;
@@ -0,0 +1,27 @@
+ALTER SERVER mssql_svr OPTIONS (ADD fdw_startup_cost 'auto', ADD fdw_tuple_cost 'auto');
+
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.auto_costs;
+
+CREATE FOREIGN TABLE @PSCHEMANAME.auto_costs (
+        id int,
+        value smallint
+)
+        SERVER mssql_svr
+        OPTIONS (schema_name '@MSCHEMANAME', table_name 'tinyint_min');
+
+/* a finished scan feeds the costs of the next plans */
+SELECT * FROM @PSCHEMANAME.auto_costs;
+
+DO $$BEGIN
+   IF NOT EXISTS (SELECT 1 FROM tds_fdw_server_stats() s JOIN pg_foreign_server f ON f.oid = s.serverid
+                  WHERE f.srvname = 'mssql_svr' AND s.scans > 0 AND s.rows_fetched > 0)
+   THEN
+      RAISE EXCEPTION 'scan was not recorded';
+   END IF;
+END;$$;
+
+EXPLAIN SELECT * FROM @PSCHEMANAME.auto_costs WHERE id = 1;
+
+DROP FOREIGN TABLE @PSCHEMANAME.auto_costs;
+
+ALTER SERVER mssql_svr OPTIONS (DROP fdw_startup_cost, DROP fdw_tuple_cost);
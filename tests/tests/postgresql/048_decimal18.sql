@@ -0,0 +1,22 @@
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.decimal18;
+
+CREATE FOREIGN TABLE @PSCHEMANAME.decimal18 (
+        id int,
+        value numeric(18, 2),
+        wide_value numeric
+)
+        SERVER mssql_svr
+        OPTIONS (table '@MSCHEMANAME.decimal18', row_estimate_method 'showplan_all');
+
+DO $$BEGIN
+   IF (SELECT value FROM @PSCHEMANAME.decimal18 WHERE id = 1) <> 12345678901234.57
+      OR (SELECT value FROM @PSCHEMANAME.decimal18 WHERE id = 2) <> -100000000000000.00
+      OR (SELECT value FROM @PSCHEMANAME.decimal18 WHERE id = 3) <> 0
+      OR (SELECT wide_value FROM @PSCHEMANAME.decimal18 WHERE id = 1) <> 1234567890123456789012345678.0123456789
+      OR (SELECT wide_value FROM @PSCHEMANAME.decimal18 WHERE id = 2) <> -0.0000000001
+   THEN
+      RAISE EXCEPTION 'decimal values were not converted correctly';
+   END IF;
+END;$$;
+
+DROP FOREIGN TABLE @PSCHEMANAME.decimal18;
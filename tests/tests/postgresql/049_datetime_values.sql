@@ -0,0 +1,48 @@
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.datetime_values;
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.datetime2_values;
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.datetimeoffset_tz_values;
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.datetimeoffset_values;
+
+CREATE FOREIGN TABLE @PSCHEMANAME.datetime_values (
+        id int,
+        value timestamp without time zone
+)
+        SERVER mssql_svr
+        OPTIONS (table '@MSCHEMANAME.datetime');
+
+CREATE FOREIGN TABLE @PSCHEMANAME.datetime2_values (
+        id int,
+        value timestamp(0) without time zone
+)
+        SERVER mssql_svr
+        OPTIONS (table '@MSCHEMANAME.datetime2');
+
+CREATE FOREIGN TABLE @PSCHEMANAME.datetimeoffset_tz_values (
+        id int,
+        value timestamp with time zone
+)
+        SERVER mssql_svr
+        OPTIONS (table '@MSCHEMANAME.datetimeoffset');
+
+/* a local timestamp gets the time as it was written on the remote server */
+CREATE FOREIGN TABLE @PSCHEMANAME.datetimeoffset_values (
+        id int,
+        value timestamp without time zone
+)
+        SERVER mssql_svr
+        OPTIONS (table '@MSCHEMANAME.datetimeoffset');
+
+DO $$BEGIN
+   IF (SELECT value FROM @PSCHEMANAME.datetime_values WHERE id = 1) <> '2015-10-22 11:01:02'
+      OR (SELECT value FROM @PSCHEMANAME.datetime2_values WHERE id = 1) <> '2015-10-22 11:01:02'
+      OR (SELECT value FROM @PSCHEMANAME.datetimeoffset_tz_values WHERE id = 1) <> '2015-10-22 18:01:02+00'
+      OR (SELECT value FROM @PSCHEMANAME.datetimeoffset_values WHERE id = 1) <> '2015-10-22 11:01:02'
+   THEN
+      RAISE EXCEPTION 'date and time values were not converted correctly';
+   END IF;
+END;$$;
+
+DROP FOREIGN TABLE @PSCHEMANAME.datetime_values;
+DROP FOREIGN TABLE @PSCHEMANAME.datetime2_values;
+DROP FOREIGN TABLE @PSCHEMANAME.datetimeoffset_tz_values;
+DROP FOREIGN TABLE @PSCHEMANAME.datetimeoffset_values;
@@ -0,0 +1,21 @@
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.bit_uniqueidentifier;
+
+CREATE FOREIGN TABLE @PSCHEMANAME.bit_uniqueidentifier (
+        id int,
+        flag boolean,
+        guid uuid
+)
+        SERVER mssql_svr
+        OPTIONS (table '@MSCHEMANAME.bit_uniqueidentifier', row_estimate_method 'showplan_all');
+
+DO $$BEGIN
+   IF (SELECT flag FROM @PSCHEMANAME.bit_uniqueidentifier WHERE id = 1) IS NOT TRUE
+      OR (SELECT flag FROM @PSCHEMANAME.bit_uniqueidentifier WHERE id = 2) IS NOT FALSE
+      OR (SELECT guid FROM @PSCHEMANAME.bit_uniqueidentifier WHERE id = 1) <> '6f9619ff-8b86-d011-b42d-00c04fc964ff'
+      OR (SELECT guid FROM @PSCHEMANAME.bit_uniqueidentifier WHERE id = 2) IS NOT NULL
+   THEN
+      RAISE EXCEPTION 'bit and uniqueidentifier values were not converted correctly';
+   END IF;
+END;$$;
+
+DROP FOREIGN TABLE @PSCHEMANAME.bit_uniqueidentifier;
@@ -0,0 +1,37 @@
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.char_lengths;
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.varchar_too_short;
+
+CREATE FOREIGN TABLE @PSCHEMANAME.char_lengths (
+        id int,
+        value char(20),
+        name_value name
+)
+        SERVER mssql_svr
+        OPTIONS (query 'SELECT id, value, value AS name_value FROM @MSCHEMANAME.varchar');
+
+CREATE FOREIGN TABLE @PSCHEMANAME.varchar_too_short (
+        id int,
+        value varchar(4)
+)
+        SERVER mssql_svr
+        OPTIONS (table '@MSCHEMANAME.varchar');
+
+DO $$BEGIN
+   IF (SELECT octet_length(value) FROM @PSCHEMANAME.char_lengths WHERE id = 1) <> 20
+      OR (SELECT value FROM @PSCHEMANAME.char_lengths WHERE id = 1) <> 'this is a string'
+      OR (SELECT name_value FROM @PSCHEMANAME.char_lengths WHERE id = 1) <> 'this is a string'
+   THEN
+      RAISE EXCEPTION 'character values were not converted correctly';
+   END IF;
+END;$$;
+
+DO $$BEGIN
+   PERFORM * FROM @PSCHEMANAME.varchar_too_short;
+   RAISE EXCEPTION 'value too long for varchar(4) was accepted';
+EXCEPTION
+   WHEN string_data_right_truncation THEN
+      NULL;
+END;$$;
+
+DROP FOREIGN TABLE @PSCHEMANAME.char_lengths;
+DROP FOREIGN TABLE @PSCHEMANAME.varchar_too_short;
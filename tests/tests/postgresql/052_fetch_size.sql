@@ -0,0 +1,20 @@
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.fetch_size_table;
+
+CREATE FOREIGN TABLE @PSCHEMANAME.fetch_size_table (
+        id int,
+        value numeric(18, 4)
+)
+        SERVER mssql_svr
+        OPTIONS (table '@MSCHEMANAME.decimal18', fetch_size '2');
+
+DO $$BEGIN
+   IF (SELECT count(*) FROM @PSCHEMANAME.fetch_size_table) <> 3
+      OR (SELECT sum(id) FROM @PSCHEMANAME.fetch_size_table) <> 6
+      OR (SELECT count(*) FROM @PSCHEMANAME.fetch_size_table a
+            JOIN @PSCHEMANAME.fetch_size_table b ON a.id <= b.id) <> 6
+   THEN
+      RAISE EXCEPTION 'rows were not fetched correctly with fetch_size';
+   END IF;
+END;$$;
+
+DROP FOREIGN TABLE @PSCHEMANAME.fetch_size_table;
@@ -0,0 +1,36 @@
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.max_lob_size_table;
+
+CREATE FOREIGN TABLE @PSCHEMANAME.max_lob_size_table (
+        id int,
+        value text
+)
+        SERVER mssql_svr
+        OPTIONS (table '@MSCHEMANAME.varcharmax', max_lob_size '4', truncate_lobs 'true');
+
+DO $$BEGIN
+   IF (SELECT value FROM @PSCHEMANAME.max_lob_size_table WHERE id = 1) <> 'this'
+   THEN
+      RAISE EXCEPTION 'varchar(max) value was not truncated to max_lob_size';
+   END IF;
+END;$$;
+
+ALTER FOREIGN TABLE @PSCHEMANAME.max_lob_size_table OPTIONS (SET truncate_lobs 'false');
+
+DO $$BEGIN
+   PERFORM * FROM @PSCHEMANAME.max_lob_size_table;
+   RAISE EXCEPTION 'varchar(max) value longer than max_lob_size was not rejected';
+EXCEPTION
+   WHEN fdw_invalid_string_length_or_buffer_length THEN
+      NULL;
+END;$$;
+
+ALTER FOREIGN TABLE @PSCHEMANAME.max_lob_size_table OPTIONS (SET max_lob_size '100');
+
+DO $$BEGIN
+   IF (SELECT value FROM @PSCHEMANAME.max_lob_size_table WHERE id = 1) <> 'this is a string'
+   THEN
+      RAISE EXCEPTION 'varchar(max) value within max_lob_size was changed';
+   END IF;
+END;$$;
+
+DROP FOREIGN TABLE @PSCHEMANAME.max_lob_size_table;
@@ -0,0 +1,29 @@
+DROP TABLE IF EXISTS @PSCHEMANAME.async_append_table;
+
+CREATE TABLE @PSCHEMANAME.async_append_table (
+        id int,
+        value numeric(18, 4)
+) PARTITION BY RANGE (id);
+
+CREATE FOREIGN TABLE @PSCHEMANAME.async_append_table_1
+        PARTITION OF @PSCHEMANAME.async_append_table FOR VALUES FROM (1) TO (3)
+        SERVER mssql_svr
+        OPTIONS (query 'SELECT id, value FROM @MSCHEMANAME.decimal18 WHERE id < 3', async_capable 'true');
+
+CREATE FOREIGN TABLE @PSCHEMANAME.async_append_table_2
+        PARTITION OF @PSCHEMANAME.async_append_table FOR VALUES FROM (3) TO (4)
+        SERVER mssql_svr
+        OPTIONS (query 'SELECT id, value FROM @MSCHEMANAME.decimal18 WHERE id >= 3', async_capable 'true', fetch_size '2');
+
+EXPLAIN (COSTS OFF) SELECT * FROM @PSCHEMANAME.async_append_table;
+
+DO $$BEGIN
+   IF (SELECT count(*) FROM @PSCHEMANAME.async_append_table) <> 3
+      OR (SELECT sum(id) FROM @PSCHEMANAME.async_append_table) <> 6
+      OR (SELECT count(*) FROM @PSCHEMANAME.async_append_table WHERE value < 0) <> 1
+   THEN
+      RAISE EXCEPTION 'rows were not fetched correctly by asynchronous scans';
+   END IF;
+END;$$;
+
+DROP TABLE @PSCHEMANAME.async_append_table;
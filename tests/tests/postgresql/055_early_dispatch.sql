@@ -0,0 +1,26 @@
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.early_dispatch_table;
+
+CREATE FOREIGN TABLE @PSCHEMANAME.early_dispatch_table (
+        id int,
+        value numeric(18, 4)
+)
+        SERVER mssql_svr
+        OPTIONS (table '@MSCHEMANAME.decimal18', early_dispatch 'true');
+
+EXPLAIN SELECT * FROM @PSCHEMANAME.early_dispatch_table;
+
+DO $$BEGIN
+   IF (SELECT count(*) FROM @PSCHEMANAME.early_dispatch_table a
+         JOIN @PSCHEMANAME.early_dispatch_table b USING (id)) <> 3
+      OR (SELECT count(*) FROM @PSCHEMANAME.early_dispatch_table a
+            JOIN @PSCHEMANAME.early_dispatch_table b ON a.id <= b.id) <> 6
+   THEN
+      RAISE EXCEPTION 'rows were not fetched correctly with early_dispatch';
+   END IF;
+END;$$;
+
+-- the scan of the inner side is never run, so its query is cancelled
+SELECT * FROM @PSCHEMANAME.early_dispatch_table a
+   WHERE a.id > 10 AND EXISTS (SELECT 1 FROM @PSCHEMANAME.early_dispatch_table b WHERE b.id = a.id);
+
+DROP FOREIGN TABLE @PSCHEMANAME.early_dispatch_table;
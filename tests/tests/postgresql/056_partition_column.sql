@@ -0,0 +1,55 @@
+DROP FOREIGN TABLE IF EXISTS @PSCHEMANAME.partition_column_table;
+
+CREATE FOREIGN TABLE @PSCHEMANAME.partition_column_table (
+        id int,
+        value numeric(18, 4)
+)
+        SERVER mssql_svr
+        OPTIONS (table '@MSCHEMANAME.decimal18', partition_column 'id', fetch_size '2');
+
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET max_parallel_workers_per_gather = 2;
+
+EXPLAIN (COSTS OFF) SELECT * FROM @PSCHEMANAME.partition_column_table;
+
+DO $$DECLARE
+   plan json;
+BEGIN
+   EXECUTE 'EXPLAIN (FORMAT JSON) SELECT * FROM @PSCHEMANAME.partition_column_table' INTO plan;
+
+   IF plan::text NOT LIKE '%"Gather"%' THEN
+      RAISE EXCEPTION 'the table was not scanned in parallel: %', plan;
+   END IF;
+
+   IF (SELECT count(*) FROM @PSCHEMANAME.partition_column_table) <> 3
+      OR (SELECT sum(id) FROM @PSCHEMANAME.partition_column_table) <> 6
+      OR (SELECT count(*) FROM @PSCHEMANAME.partition_column_table WHERE value < 0) <> 1
+      OR (SELECT count(*) FROM @PSCHEMANAME.partition_column_table WHERE id >= 2) <> 2
+   THEN
+      RAISE EXCEPTION 'rows were not fetched correctly by the parallel scan';
+   END IF;
+END;$$;
+
+-- a column of another type can't be split into ranges, so it is scanned serially
+ALTER FOREIGN TABLE @PSCHEMANAME.partition_column_table OPTIONS (SET partition_column 'value');
+
+DO $$DECLARE
+   plan json;
+BEGIN
+   EXECUTE 'EXPLAIN (FORMAT JSON) SELECT * FROM @PSCHEMANAME.partition_column_table' INTO plan;
+
+   IF plan::text LIKE '%"Gather"%' THEN
+      RAISE EXCEPTION 'the table was scanned in parallel by a numeric column: %', plan;
+   END IF;
+
+   IF (SELECT count(*) FROM @PSCHEMANAME.partition_column_table) <> 3 THEN
+      RAISE EXCEPTION 'rows were not fetched correctly by the serial scan';
+   END IF;
+END;$$;
+
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET max_parallel_workers_per_gather;
+
+DROP FOREIGN TABLE @PSCHEMANAME.partition_column_table;